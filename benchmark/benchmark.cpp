@@ -0,0 +1,530 @@
+/**
+ * @brief Headless benchmark of BagPlayer.
+ *
+ * Writes synthetic bags with a configurable size and topic mix, and
+ * drives a BagPlayer through its C++ API without RViz nor Qt,
+ * measuring the load time and peak memory, the seek and reverse-start
+ * latencies, and the sustained forward and reverse throughput.
+ *
+ * The latencies are measured up to the first message received by a
+ * subscriber of the first topic, so they include the read-ahead, the
+ * transport and the wait for that message, at most 1/rate seconds of
+ * the recording. It needs a running roscore. The parameters of the
+ * player are read from the private namespace of the benchmark node,
+ * e.g. _decode_threads:=4.
+ *
+ * Built with BENCHMARK_GTEST, it is a rostest instead, run on a short
+ * recording, that fails if a seek or a reverse start times out.
+ *
+ */
+
+#include <diagnostic_msgs/KeyValue.h>
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rosbag_rviz_panel/BagIndex.h"
+#include "rosbag_rviz_panel/BagPlayer.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief Command line options of the benchmark.
+ */
+struct Options
+{
+    double      duration{60.0};      // Seconds of recording
+    int         topics{4};           // Topic k is published at rate / (k + 1) with (k + 1) * message_bytes
+    double      rate{100.0};         // Hz of the first topic
+    int         message_bytes{1024}; // Bytes of the messages of the first topic
+    std::string compression{"lz4"};  // none, lz4 or bz2
+    int         bags{1};             // The topics are split over the bags, as per-sensor recordings
+    int         seeks{20};           // Seeks and reverse starts measured
+    std::string directory{"/tmp"};   // Where the bags are written
+};
+
+/**
+ * @brief Prints the usage of the benchmark.
+ */
+void printUsage(const char* program)
+{
+    const Options defaults;
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --duration <s>       Seconds of recording (" << defaults.duration << ")\n"
+              << "  --topics <n>         Topics, topic k at rate / (k + 1) with (k + 1) * bytes (" << defaults.topics
+              << ")\n"
+              << "  --rate <hz>          Rate of the first topic (" << defaults.rate << ")\n"
+              << "  --bytes <n>          Message size of the first topic (" << defaults.message_bytes << ")\n"
+              << "  --compression <c>    none, lz4 or bz2 (" << defaults.compression << ")\n"
+              << "  --bags <n>           Bags the topics are split over (" << defaults.bags << ")\n"
+              << "  --seeks <n>          Seeks and reverse starts measured (" << defaults.seeks << ")\n"
+              << "  --dir <path>         Directory of the bags (" << defaults.directory << ")\n";
+}
+
+/**
+ * @brief Parses the command line options left by ros::init().
+ *
+ * @return bool set to false if an option is unknown or has no value.
+ */
+bool parseOptions(const int argc, char** argv, Options& options)
+{
+    for (int arg = 1; arg < argc; ++arg) {
+        const std::string name = argv[arg];
+        if (arg + 1 >= argc)
+            return false;
+
+        const std::string value = argv[++arg];
+        if (name == "--duration")
+            options.duration = std::stod(value);
+        else if (name == "--topics")
+            options.topics = std::max(std::stoi(value), 1);
+        else if (name == "--rate")
+            options.rate = std::stod(value);
+        else if (name == "--bytes")
+            options.message_bytes = std::max(std::stoi(value), 1);
+        else if (name == "--compression")
+            options.compression = value;
+        else if (name == "--bags")
+            options.bags = std::max(std::stoi(value), 1);
+        else if (name == "--seeks")
+            options.seeks = std::max(std::stoi(value), 1);
+        else if (name == "--dir")
+            options.directory = value;
+        else
+            return false;
+    }
+
+    return options.duration > 0.0 && options.rate > 0.0;
+}
+
+/**
+ * @brief Returns the name of a synthetic topic.
+ */
+std::string topicName(const int topic)
+{
+    return "/benchmark/topic_" + std::to_string(topic);
+}
+
+/**
+ * @brief Writes the synthetic bags. Every message is a KeyValue whose
+ * key is its time stamp in nanoseconds, so the subscriber can tell
+ * where it comes from, and whose value is the payload.
+ *
+ * @return std::size_t with the number of messages written.
+ */
+std::size_t writeBags(const Options& options, const ros::Time& start, std::vector<std::string>& filenames)
+{
+    std::vector<std::unique_ptr<rosbag::Bag>> bags;
+    for (int bag = 0; bag < options.bags; ++bag) {
+        const auto filename = options.directory + "/rosbag_rviz_panel_benchmark_" + std::to_string(bag) + ".bag";
+        bags.push_back(std::make_unique<rosbag::Bag>(filename, rosbag::bagmode::Write));
+        if (options.compression == "lz4")
+            bags.back()->setCompression(rosbag::compression::LZ4);
+        else if (options.compression == "bz2")
+            bags.back()->setCompression(rosbag::compression::BZ2);
+        filenames.push_back(filename);
+    }
+
+    // Messages of every topic, in time order, with a payload that compresses like sensor data
+    struct Next
+    {
+        ros::Time stamp;
+        int       topic;
+    };
+    std::vector<Next> next;
+    for (int topic = 0; topic < options.topics; ++topic)
+        next.push_back(Next{start, topic});
+
+    const auto  end = start + ros::Duration(options.duration);
+    std::size_t messages{0};
+    uint32_t    seed{1};
+    while (true) {
+        auto earliest = std::min_element(next.begin(), next.end(), [](const Next& a, const Next& b) {
+            return a.stamp < b.stamp;
+        });
+        if (earliest->stamp > end)
+            break;
+
+        diagnostic_msgs::KeyValue message;
+        message.key = std::to_string(earliest->stamp.toNSec());
+        message.value.resize(static_cast<std::size_t>(options.message_bytes) * (earliest->topic + 1));
+        for (auto& c : message.value) {
+            seed = seed * 1103515245 + 12345;
+            c    = static_cast<char>('a' + (seed >> 16) % 16);
+        }
+
+        bags[earliest->topic % options.bags]->write(topicName(earliest->topic), earliest->stamp, message);
+        ++messages;
+
+        earliest->stamp += ros::Duration((earliest->topic + 1) / options.rate);
+    }
+
+    for (auto& bag : bags)
+        bag->close();
+
+    return messages;
+}
+
+/**
+ * @brief Resets the peak resident memory of the process, see VmHWM.
+ */
+void resetPeakMemory(void)
+{
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+/**
+ * @brief Returns the peak resident memory of the process in MB.
+ */
+double peakMemoryMb(void)
+{
+    std::ifstream status("/proc/self/status");
+    std::string   line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0)
+            return std::stod(line.substr(6)) / 1024.0;
+    }
+
+    return 0.0;
+}
+
+/**
+ * @brief Returns the seconds elapsed since a time point.
+ */
+double secondsSince(const Clock::time_point& start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * @brief Event raised by the player listener or by a received message,
+ * waited on by the benchmark.
+ */
+class Event
+{
+  public:
+    /**
+     * @brief Clears the event, and sets the condition that raises it
+     * for the received messages.
+     *
+     * @param match Function called with the time stamp of every received
+     *        message, returning true to raise the event.
+     */
+    void reset(std::function<bool(const uint64_t)> match = nullptr)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _raised = false;
+        _match  = std::move(match);
+    }
+
+    /**
+     * @brief Raises the event.
+     */
+    void raise(void)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_raised)
+                return;
+            _raised    = true;
+            _raised_at = Clock::now();
+        }
+        _raised_cv.notify_all();
+    }
+
+    /**
+     * @brief Raises the event if a received message matches.
+     */
+    void receive(const diagnostic_msgs::KeyValue::ConstPtr& message)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_match || !_match(std::stoull(message->key)))
+                return;
+        }
+        raise();
+    }
+
+    /**
+     * @brief Waits for the event.
+     *
+     * @param timeout Double with the seconds to wait at most.
+     *
+     * @return bool set to false if the event was not raised in time.
+     */
+    bool wait(const double timeout)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _raised_cv.wait_for(lock, std::chrono::duration<double>(timeout), [this]() { return _raised; });
+    }
+
+    /**
+     * @brief Returns the time point at which the event was raised.
+     */
+    Clock::time_point raisedAt(void)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _raised_at;
+    }
+
+  private:
+    std::mutex                          _mutex;
+    std::condition_variable             _raised_cv;
+    bool                                _raised{false};
+    Clock::time_point                   _raised_at;
+    std::function<bool(const uint64_t)> _match;
+};
+
+/**
+ * @brief Listener of the player, raising the events of the benchmark
+ * from the threads of the player.
+ */
+class Listener : public rosbag_rviz_panel::BagPlayer::Listener
+{
+  public:
+    Event             finished, indexed;
+    std::atomic<bool> indexing{false};
+
+    /**
+     * @brief Raises the finished event at the end of a playback.
+     */
+    void onBagFinished(void) override { finished.raise(); }
+
+    /**
+     * @brief Raises the indexed event once the bags are indexed, if they
+     * were indexed in the background.
+     */
+    void onEnableSeekControls(const bool enable) override
+    {
+        if (!enable)
+            indexing = true;
+        else
+            indexed.raise();
+    }
+};
+
+/**
+ * @brief Prints the minimum, median, 95th percentile and maximum of
+ * latencies in milliseconds.
+ */
+void printLatencies(const std::string& name, std::vector<double> latencies, const int failures)
+{
+    if (latencies.empty()) {
+        std::printf("%-24s no message received\n", name.c_str());
+        return;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    const auto at = [&latencies](const double fraction) {
+        return latencies[static_cast<std::size_t>(fraction * (latencies.size() - 1))] * 1000.0;
+    };
+    std::printf(
+            "%-24s min %.2f ms, median %.2f ms, p95 %.2f ms, max %.2f ms",
+            name.c_str(),
+            at(0.0),
+            at(0.5),
+            at(0.95),
+            at(1.0));
+    if (failures > 0)
+        std::printf(", %d timed out", failures);
+    std::printf("\n");
+}
+
+/**
+ * @brief Runs the whole benchmark, printing its results.
+ *
+ * @return int set to 0 if every seek and reverse start received a
+ *         message in time, 1 otherwise or if the bags could not be
+ *         played.
+ */
+int runBenchmark(const Options& options)
+{
+    // Synthetic recording
+    const ros::Time start(1000, 0);
+    std::vector<std::string> filenames;
+    auto                     t0       = Clock::now();
+    const auto               messages = writeBags(options, start, filenames);
+    std::printf(
+            "Wrote %zu messages on %d topics in %d %s bag(s) in %.2f s\n",
+            messages,
+            options.topics,
+            options.bags,
+            options.compression.c_str(),
+            secondsSince(t0));
+
+    Listener                     listener;
+    rosbag_rviz_panel::BagPlayer player(&listener);
+    Event                        received;
+    auto&                        finished = listener.finished;
+    auto&                        indexed  = listener.indexed;
+
+    ros::NodeHandle   nh;
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
+    const auto subscriber = nh.subscribe(topicName(0), 1000, &Event::receive, &received);
+
+    // Load, without and then with the sidecar indexes
+    for (const bool sidecar : {false, true}) {
+        if (!sidecar) {
+            for (const auto& filename : filenames)
+                std::remove(rosbag_rviz_panel::BagIndex::sidecarPath(filename).c_str());
+        }
+
+        resetPeakMemory();
+        listener.indexing = false;
+        indexed.reset();
+        t0 = Clock::now();
+        if (!player.load(filenames)) {
+            std::cerr << "Could not load the bags" << std::endl;
+            return 1;
+        }
+        const auto opened = secondsSince(t0);
+        if (listener.indexing && !indexed.wait(600.0)) {
+            std::cerr << "Indexing timed out" << std::endl;
+            return 1;
+        }
+
+        std::printf(
+                "Load %-19s open %.3f s, indexed %.3f s, peak memory %.1f MB\n",
+                sidecar ? "(sidecar)" : "(no sidecar)",
+                opened,
+                secondsSince(t0),
+                peakMemoryMb());
+    }
+
+    // Wait for the subscriber to be connected
+    ros::Duration(1.0).sleep();
+
+    // Sustained throughput, forward and backwards
+    player.setUnthrottled(true);
+    for (const bool forward : {true, false}) {
+        player.setSpeed(forward ? 1.0 : -1.0);
+        if (forward)
+            player.gotoBegin();
+        else
+            player.gotoEnd();
+
+        finished.reset();
+        t0 = Clock::now();
+        player.play();
+        if (!finished.wait(600.0)) {
+            std::cerr << "Playback timed out" << std::endl;
+            return 1;
+        }
+
+        const auto elapsed = secondsSince(t0);
+        std::printf(
+                "Playback %-15s %.0f msg/s (%.2f s)\n",
+                forward ? "forward" : "backwards",
+                messages / elapsed,
+                elapsed);
+    }
+    player.setUnthrottled(false);
+
+    // Seeks spread over the bag while playing, up to the first message after the seek
+    const auto progress_time = [&options, &start](const int progress) {
+        return (start + ros::Duration(options.duration * progress / 100)).toNSec();
+    };
+    const auto window = static_cast<uint64_t>(options.duration * 1e7); // 1% of the bag, to skip the previous messages
+
+    std::vector<double> seek_latencies;
+    int                 seek_failures{0};
+    player.setSpeed(1.0);
+    player.gotoBegin();
+    player.play();
+    for (int seek = 0; seek < options.seeks; ++seek) {
+        const int  progress = 5 + (seek * 37) % 90;
+        const auto target   = progress_time(progress);
+        received.reset([target, window](const uint64_t stamp) { return stamp >= target && stamp < target + window; });
+
+        t0 = Clock::now();
+        player.seekProgress(progress / 100.0);
+        if (received.wait(5.0))
+            seek_latencies.push_back(std::chrono::duration<double>(received.raisedAt() - t0).count());
+        else
+            ++seek_failures;
+    }
+    player.pause();
+    printLatencies("Seek", seek_latencies, seek_failures);
+
+    // Reverse starts from a paused playhead
+    std::vector<double> reverse_latencies;
+    int                 reverse_failures{0};
+    for (int seek = 0; seek < options.seeks; ++seek) {
+        const int progress = 5 + (seek * 37) % 90;
+        player.setSpeed(1.0);
+        player.seekProgress(progress / 100.0);
+        player.setSpeed(-1.0);
+
+        const auto target = progress_time(progress);
+        received.reset([target, window](const uint64_t stamp) { return stamp < target && stamp + window > target; });
+
+        t0 = Clock::now();
+        player.play();
+        if (received.wait(5.0))
+            reverse_latencies.push_back(std::chrono::duration<double>(received.raisedAt() - t0).count());
+        else
+            ++reverse_failures;
+        player.pause();
+    }
+    printLatencies("Reverse start", reverse_latencies, reverse_failures);
+
+    spinner.stop();
+    return seek_failures + reverse_failures > 0 ? 1 : 0;
+}
+
+} // namespace
+
+#ifdef BENCHMARK_GTEST
+
+#include <gtest/gtest.h>
+
+// A short recording, so the regressions of the seek and reverse-start latencies fail the tests quickly
+TEST(Benchmark, SeeksAndReverseStartsDoNotTimeOut)
+{
+    Options options;
+    options.duration      = 10.0;
+    options.topics        = 2;
+    options.rate          = 50.0;
+    options.message_bytes = 256;
+    options.seeks         = 10;
+    EXPECT_EQ(runBenchmark(options), 0);
+}
+
+int main(int argc, char** argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    ros::init(argc, argv, "rosbag_rviz_panel_benchmark_test", ros::init_options::AnonymousName);
+    return RUN_ALL_TESTS();
+}
+
+#else
+
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "rosbag_rviz_panel_benchmark", ros::init_options::AnonymousName);
+
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    return runBenchmark(options);
+}
+
+#endif
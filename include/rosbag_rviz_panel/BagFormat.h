@@ -0,0 +1,124 @@
+#pragma once
+
+#include <ros/time.h>
+#include <rosbag/exceptions.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "BagSource.h"
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief Low level helpers to read the records of a rosbag
+ * V2.0 file without going through rosbag::Bag.
+ *
+ * Every record in the file is stored as:
+ * <header_len><header><data_len><data>, where the header is
+ * a sequence of <field_len><name>=<value> fields.
+ *
+ */
+namespace bag_format {
+
+constexpr char        VERSION_LINE[]      = "#ROSBAG V2.0\n";
+constexpr std::size_t VERSION_LINE_LENGTH = sizeof(VERSION_LINE) - 1;
+
+constexpr uint8_t OP_MSG_DATA    = 0x02;
+constexpr uint8_t OP_FILE_HEADER = 0x03;
+constexpr uint8_t OP_INDEX_DATA  = 0x04;
+constexpr uint8_t OP_CHUNK       = 0x05;
+constexpr uint8_t OP_CHUNK_INFO  = 0x06;
+constexpr uint8_t OP_CONNECTION  = 0x07;
+
+using FieldMap = std::map<std::string, std::string>;
+
+/**
+ * @brief Header and data location of a single record.
+ */
+struct Record
+{
+    FieldMap fields;
+    uint64_t data_pos{0};
+    uint32_t data_len{0};
+
+    /**
+     * @brief Position of the record that follows this one.
+     */
+    uint64_t nextPos() const { return data_pos + data_len; }
+};
+
+/**
+ * @brief Reads the header of the record at the given position.
+ *
+ * @param source BagSource of the rosbag.
+ * @param pos uint64_t with the absolute position of the record.
+ *
+ * @return Record with the parsed header fields and the data location.
+ */
+Record readRecord(const BagSource& source, uint64_t pos);
+
+/**
+ * @brief Reads the header of the record at the given position of a
+ * file mapped in memory, without any system call.
+ *
+ * @param file Pointer to the first byte of the mapped file.
+ * @param size std::size_t with the size of the file in bytes.
+ * @param pos uint64_t with the absolute position of the record.
+ *
+ * @return Record with the parsed header fields and the data location.
+ *
+ * @throws rosbag::BagFormatException if the record exceeds the file.
+ */
+Record readRecord(const uint8_t* file, std::size_t size, uint64_t pos);
+
+/**
+ * @brief Splits a serialized header into its fields.
+ *
+ * @param data Pointer to the first byte of the header.
+ * @param len uint32_t with the header length in bytes.
+ *
+ * @return FieldMap with every name=value pair of the header.
+ */
+FieldMap parseHeader(const uint8_t* data, uint32_t len);
+
+/**
+ * @brief Returns the op code of a record header.
+ *
+ * @throws rosbag::BagFormatException if the field is missing.
+ */
+uint8_t readOp(const FieldMap& fields);
+
+/**
+ * @brief Reads a little-endian uint32_t field.
+ *
+ * @throws rosbag::BagFormatException if the field is missing or malformed.
+ */
+uint32_t readUInt32(const FieldMap& fields, const std::string& name);
+
+/**
+ * @brief Reads a little-endian uint64_t field.
+ *
+ * @throws rosbag::BagFormatException if the field is missing or malformed.
+ */
+uint64_t readUInt64(const FieldMap& fields, const std::string& name);
+
+/**
+ * @brief Reads a time field stored as <sec><nsec>.
+ *
+ * @throws rosbag::BagFormatException if the field is missing or malformed.
+ */
+ros::Time readTime(const FieldMap& fields, const std::string& name);
+
+/**
+ * @brief Decodes a time stored as <sec><nsec> in a raw buffer.
+ *
+ * @param data Pointer to 8 bytes with the serialized time.
+ *
+ * @return ros::Time with the decoded value.
+ */
+ros::Time decodeTime(const uint8_t* data);
+
+} // namespace bag_format
+} // namespace rosbag_rviz_panel
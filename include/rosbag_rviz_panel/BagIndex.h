@@ -0,0 +1,297 @@
+#pragma once
+
+#include <ros/time.h>
+#include <rosbag/structures.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief BagIndex.
+ *
+ * Compact time index of a rosbag, built from the connection, chunk
+ * info and index data records of the file, without reading any
+ * message data.
+ *
+ * Every message is stored as a structure-of-arrays entry (stamp,
+ * connection id, chunk id and offset inside the chunk) sorted by
+ * time, so any time stamp resolves to a message by binary search.
+ *
+ * Opening a bag only reads its index section (connections and chunk
+ * infos), the message arrays are then filled by build(), which can
+ * run on a background thread: the messages already indexed can be
+ * read meanwhile, since the arrays only grow in time order.
+ *
+ * Once built, the messages of every connection are also listed in
+ * time order, so the last message of a connection before any time
+ * stamp is found by binary search too.
+ *
+ * Once built, the index can be written to a sidecar file in the
+ * user cache directory and memory-mapped when the same bag (same
+ * path or URL, size and version, see BagSource::version()) is opened
+ * again. A URL is compared without its query, so a presigned URL
+ * that is signed again still finds its sidecar, and the query is
+ * never written to disk. A remote bag without a version has no
+ * sidecar, its size alone does not tell an updated object.
+ *
+ */
+class BagIndex
+{
+  public:
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+    /**
+     * @brief Location and time range of a chunk in the bag.
+     */
+    struct ChunkInfo
+    {
+        ros::Time start_time;
+        ros::Time end_time;
+        uint64_t  pos{0};
+        uint32_t  connection_count{0};
+        uint32_t  message_count{0};
+    };
+
+    /**
+     * @brief Constructor of the BagIndex class.
+     */
+    BagIndex() = default;
+
+    /**
+     * @brief Destructor of the BagIndex class.
+     */
+    ~BagIndex();
+
+    BagIndex(const BagIndex&)            = delete;
+    BagIndex& operator=(const BagIndex&) = delete;
+
+    /**
+     * @brief Reads the index section of a rosbag: connections, chunks
+     * and time range. The messages are indexed later by build().
+     *
+     * @param filename std::string with the absolute file path or the
+     *        URL of the rosbag, see BagSource.
+     *
+     * @throws rosbag::BagException if the file can not be read or
+     *         it is not an indexed V2.0 bag.
+     */
+    void open(const std::string& filename);
+
+    /**
+     * @brief Reads the index data records of every chunk of the opened
+     * rosbag, appending the messages to the index in time order.
+     *
+     * @param progress Optional function called before every chunk with
+     *        the indexed fraction [0, 1]. Returning false cancels the build.
+     *
+     * @return bool set to false if the build was cancelled.
+     *
+     * @throws rosbag::BagException if the index data can not be read.
+     */
+    bool build(const std::function<bool(const float)>& progress = nullptr);
+
+    /**
+     * @brief Returns true while build() has not finished, so more
+     * messages can still be appended to the index.
+     */
+    bool isBuilding(void) const { return _building.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Marks an index that will not be built as complete, keeping
+     * the messages appended so far, e.g. when the indexing of an earlier
+     * rosbag failed or was cancelled.
+     */
+    void stopBuilding(void) { _building.store(false, std::memory_order_release); }
+
+    /**
+     * @brief Maps the sidecar index of a rosbag, if there is an
+     * up to date one.
+     *
+     * @param filename std::string with the absolute file path of
+     *        the rosbag.
+     *
+     * @return bool set to true if the index was mapped, false if
+     *         there is no valid sidecar for the current bag file.
+     */
+    bool mapSidecar(const std::string& filename);
+
+    /**
+     * @brief Writes the index to the sidecar file of a rosbag.
+     *
+     * @param filename std::string with the absolute file path of
+     *        the indexed rosbag.
+     *
+     * @throws rosbag::BagIOException if the sidecar can not be written.
+     */
+    void writeSidecar(const std::string& filename) const;
+
+    /**
+     * @brief Returns the path of the sidecar index of a rosbag.
+     *
+     * @param filename std::string with the absolute file path or the
+     *        URL of the rosbag, the query of the URL is ignored.
+     */
+    static std::string sidecarPath(const std::string& filename);
+
+    /**
+     * @brief Releases all the index data.
+     */
+    void clear(void);
+
+    /**
+     * @brief Returns true if the index is mapped from a sidecar file.
+     */
+    bool isMapped(void) const { return _mapping != nullptr; }
+
+    /**
+     * @brief Returns the size in bytes of the indexed file.
+     */
+    uint64_t fileSize(void) const { return _file_size; }
+
+    /**
+     * @brief Returns the position of the index section of the file,
+     * where the last chunk and its index data records end.
+     */
+    uint64_t indexPos(void) const { return _index_pos; }
+
+    /**
+     * @brief Returns the chunks of the bag, sorted by position.
+     */
+    const std::vector<ChunkInfo>& chunks(void) const { return _chunks; }
+
+    /**
+     * @brief Returns all the connections of the bag, by id.
+     */
+    const std::map<uint32_t, rosbag::ConnectionInfo>& connections(void) const { return _connections; }
+
+    /**
+     * @brief Returns the number of indexed messages.
+     */
+    std::size_t size(void) const { return _size.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Returns true if no message has been indexed.
+     */
+    bool empty(void) const { return size() == 0; }
+
+    /**
+     * @brief Returns the time stamp of the first message of the bag.
+     */
+    ros::Time startTime(void) const { return _start_time; }
+
+    /**
+     * @brief Returns the time stamp of the last message of the bag.
+     */
+    ros::Time endTime(void) const { return _end_time; }
+
+    /**
+     * @brief Returns the time stamp of a message.
+     *
+     * @param message std::size_t with the message position in the index.
+     */
+    const ros::Time& stamp(const std::size_t message) const { return _stamps[message]; }
+
+    /**
+     * @brief Returns the connection id of a message.
+     *
+     * @param message std::size_t with the message position in the index.
+     */
+    uint32_t connectionId(const std::size_t message) const { return _connection_ids[message]; }
+
+    /**
+     * @brief Returns the chunk, as a position in chunks(), that
+     * contains a message.
+     *
+     * @param message std::size_t with the message position in the index.
+     */
+    uint32_t chunkId(const std::size_t message) const { return _chunk_ids[message]; }
+
+    /**
+     * @brief Returns the offset of a message record inside the
+     * uncompressed data of its chunk.
+     *
+     * @param message std::size_t with the message position in the index.
+     */
+    uint32_t offset(const std::size_t message) const { return _offsets[message]; }
+
+    /**
+     * @brief Finds the first message not earlier than a time stamp.
+     *
+     * @param stamp ros::Time with the time stamp to look for.
+     *
+     * @return std::size_t with the message position, or size() if there
+     *         is no such message.
+     */
+    std::size_t lowerBound(const ros::Time& stamp) const;
+
+    /**
+     * @brief Finds the first message later than a time stamp.
+     *
+     * @param stamp ros::Time with the time stamp to look for.
+     *
+     * @return std::size_t with the message position, or size() if there
+     *         is no such message.
+     */
+    std::size_t upperBound(const ros::Time& stamp) const;
+
+    /**
+     * @brief Finds the last message of a connection earlier than a time
+     * stamp. Only available once the index is built.
+     *
+     * @param connection_id uint32_t with the connection id in the bag.
+     * @param stamp ros::Time with the time stamp to look before.
+     *
+     * @return std::size_t with the message position, or npos if the
+     *         connection has no message before the time stamp.
+     */
+    std::size_t lastBefore(const uint32_t connection_id, const ros::Time& stamp) const;
+
+  private:
+    /**
+     * @brief Points the message arrays to the owned storage.
+     */
+    void useStorage(void);
+
+    /**
+     * @brief Lists the messages of every connection, once all the
+     * messages are indexed.
+     */
+    void indexConnections(void);
+
+    std::string _filename;
+    uint64_t    _file_size{0};
+    uint64_t    _index_pos{0};
+    std::string _file_version;
+    ros::Time   _start_time, _end_time;
+
+    std::vector<ChunkInfo>                     _chunks;
+    std::map<uint32_t, rosbag::ConnectionInfo> _connections;
+
+    // Message arrays, pointing either to the storage vectors or to the sidecar mapping
+    std::atomic<std::size_t> _size{0};
+    std::atomic<bool>        _building{false};
+    const ros::Time*         _stamps{nullptr};
+    const uint32_t*          _connection_ids{nullptr};
+    const uint32_t*          _chunk_ids{nullptr};
+    const uint32_t*          _offsets{nullptr};
+
+    std::vector<ros::Time> _stamp_storage;
+    std::vector<uint32_t>  _connection_id_storage;
+    std::vector<uint32_t>  _chunk_id_storage;
+    std::vector<uint32_t>  _offset_storage;
+
+    // Message positions of every connection, in time order
+    std::map<uint32_t, std::vector<uint32_t>> _connection_messages;
+
+    void*       _mapping{nullptr};
+    std::size_t _mapping_size{0};
+};
+
+} // namespace rosbag_rviz_panel
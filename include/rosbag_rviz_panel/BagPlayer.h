@@ -0,0 +1,967 @@
+#pragma once
+
+#include <ros/ros.h>
+#include <rosbag/exceptions.h>
+#include <rosbag/macros.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BagSet.h"
+#include "MessagePrefetcher.h"
+#include "RawMessage.h"
+#include "SeqLock.h"
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief Upper limits, in milliseconds, of the bins of the lateness
+ * histogram. The last bin counts the messages later than the last limit.
+ */
+constexpr std::array<double, 7> LATENESS_BIN_LIMITS_MS = {1.0, 5.0, 10.0, 50.0, 100.0, 500.0, 1000.0};
+constexpr std::size_t           LATENESS_BINS          = LATENESS_BIN_LIMITS_MS.size() + 1;
+
+/**
+ * @brief Playhead location sent to the user interface, which
+ * formats it into the labels and the progress bar, along with
+ * the read-ahead metrics of the playback.
+ */
+struct PlayheadState
+{
+    ros::Time   stamp;
+    ros::Time   bag_start;
+    ros::Time   bag_end;
+    ros::Time   range_start;       // Range played, the whole bag if no A/B range is set
+    ros::Time   range_end;
+    bool        loop{false};       // True if the range is played in a loop
+    std::size_t queue_depth{0};    // Messages read ahead of the playhead
+    std::size_t queue_capacity{0}; // Maximum messages read ahead
+    double      max_lateness{0.0}; // Seconds, worst publish delay since the last state
+    double      message_rate{0.0}; // Published messages per second
+    double      byte_rate{0.0};    // Published bytes per second
+    double      read_rate{0.0};    // Bytes per second read from the bag files
+    double      read_load{0.0};    // Seconds per second spent reading the bag files, by every thread
+    double      decode_load{0.0};  // Seconds per second spent decompressing the chunks, by every thread
+    double      publish_load{0.0}; // Seconds per second spent publishing
+    bool        valid{false};      // False to clear the labels
+
+    // Messages due since the bag was loaded, by lateness bin, and late messages dropped
+    std::array<uint64_t, LATENESS_BINS> lateness_histogram{};
+    uint64_t                            dropped_messages{0};
+};
+
+/**
+ * @brief Number of bins of the timeline density, downsampled by the
+ * progress bar to its width.
+ */
+constexpr std::size_t DENSITY_BINS = 4096;
+
+/**
+ * @brief Density of the selected topics, or of a single topic, over the
+ * whole bags, computed from the indexes, in DENSITY_BINS bins of equal
+ * duration.
+ */
+struct TimelineDensity
+{
+    std::vector<uint32_t> messages; // Messages by bin, empty until the bags are indexed
+    std::vector<uint64_t> bytes;    // Bytes of the bag files by bin, the chunks shared evenly by their messages
+};
+
+/**
+ * @brief Options of the publishers of the bag topics.
+ */
+struct PublisherOptions
+{
+    uint32_t                        queue_size{1}; // Of the topics without their own queue size, 0 for unbounded
+    std::map<std::string, uint32_t> queue_sizes;   // By bag topic
+    std::string                     prefix;        // Prepended to the bag topics, e.g. /replay
+};
+
+/**
+ * @brief BagPlayer.
+ *
+ * Playback engine without any Qt dependency: it opens a set of
+ * rosbags and plays them as one timeline, forward or backwards, at
+ * different speed rates, publishing their messages on ROS topics.
+ * QBagPlayer wraps it for the panel, and it can be embedded as is in
+ * a headless replay node.
+ *
+ * The commands are plain methods, which must be called from one
+ * thread at a time, and the engine reports its state to a Listener.
+ *
+ * The bag is played by a thread that lives as long as the player
+ * and waits for commands on a condition variable, so pausing,
+ * resuming and changing the speed wake it up right away, keeping
+ * the messages already read ahead.
+ *
+ */
+class ROSBAG_STORAGE_DECL BagPlayer
+{
+  public:
+    /**
+     * @brief Receives the state changes of the player. They are called
+     * from the thread of the commands, but also from the play thread
+     * and the indexing thread, so they must be thread-safe and return
+     * quickly. Every method does nothing by default.
+     */
+    class Listener
+    {
+      public:
+        /**
+         * @brief Destructor of the Listener class.
+         */
+        virtual ~Listener() = default;
+
+        /**
+         * @brief Called when the bag is finished or the playback is
+         * rewound.
+         */
+        virtual void onBagFinished(void) {}
+
+        /**
+         * @brief Called with the total size of the loaded bags.
+         *
+         * @param size std::string with the formatted size, empty to
+         *        clear it.
+         */
+        virtual void onBagSize(const std::string& /* size */) {}
+
+        /**
+         * @brief Called when the playback speed or mode changes.
+         *
+         * @param speed Double with the actual playback speed, or 0 to clear it.
+         * @param unthrottled Bool set to true if the messages are played as
+         *        fast as possible.
+         */
+        virtual void onPlaybackSpeed(const double /* speed */, const bool /* unthrottled */) {}
+
+        /**
+         * @brief Called with a text to notify the user about something.
+         *
+         * @param status std::string with the status message, empty to
+         *        clear it.
+         */
+        virtual void onStatusText(const std::string& /* status */) {}
+
+        /**
+         * @brief Called when the commands become available, once bags are
+         *        loaded, or unavailable.
+         *
+         * @param enable Bool set to true if the commands are available.
+         */
+        virtual void onEnableActionButtons(const bool /* enable */) {}
+
+        /**
+         * @brief Called with the progress of the background indexing.
+         *
+         * @param progress Int value [0, 100] with the indexed percentage.
+         */
+        virtual void onLoadProgress(const int /* progress */) {}
+
+        /**
+         * @brief Called when the commands that need the whole bag to be
+         *        indexed, seeking and reverse playback, become available
+         *        or unavailable.
+         *
+         * @param enable Bool set to true if they are available.
+         */
+        virtual void onEnableSeekControls(const bool /* enable */) {}
+
+        /**
+         * @brief Called with the current playhead location, by update()
+         *        or by the commands that move the playhead.
+         *
+         * @param state PlayheadState with the playhead and bag time stamps.
+         */
+        virtual void onPlayheadState(const PlayheadState& /* state */) {}
+
+        /**
+         * @brief Called with the topics of the loaded bags, which are all
+         *        selected on load.
+         *
+         * @param topics std::vector<std::string> with the sorted topic names.
+         */
+        virtual void onTopics(const std::vector<std::string>& /* topics */) {}
+
+        /**
+         * @brief Called with the progress of an export, from the export
+         *        thread. The result is sent with onStatusText().
+         *
+         * @param progress Int value [0, 100] with the exported percentage
+         *        of the range, 100 once the export is over.
+         */
+        virtual void onExportProgress(const int /* progress */) {}
+
+        /**
+         * @brief Called with the density of the selected topics over the
+         *        timeline, once the bags are indexed and when the
+         *        selection changes.
+         *
+         * @param density TimelineDensity with the density, empty to
+         *        clear it.
+         */
+        virtual void onTimelineDensity(const TimelineDensity& /* density */) {}
+    };
+
+    /**
+     * @brief Constructor of the BagPlayer class.
+     *
+     * @param listener Pointer to the Listener of the player, which must
+     *        outlive it, or nullptr to ignore its state changes.
+     * @param nh ros::NodeHandle to read the parameters from and to
+     *        advertise the topics of the bags with, the private
+     *        namespace of the node by default. A nodelet passes its own
+     *        private node handle.
+     */
+    explicit BagPlayer(Listener* listener = nullptr, const ros::NodeHandle& nh = ros::NodeHandle("~"));
+
+    /**
+     * @brief Destructor of the BagPlayer class.
+     */
+    ~BagPlayer();
+
+    BagPlayer(const BagPlayer&)            = delete;
+    BagPlayer& operator=(const BagPlayer&) = delete;
+
+    /**
+     * @brief Loads a set of rosbags, played as one timeline, merged by
+     *        time stamp. The bags without a sidecar index are indexed
+     *        in the background, they can already be played forward.
+     *
+     * @param filenames std::vector<std::string> with the absolute file
+     *        paths of the rosbags.
+     *
+     * @return bool set to false if a bag could not be opened.
+     */
+    bool load(const std::vector<std::string>& filenames);
+
+    /**
+     * @brief Sets the time stamp for the beginning of the bag.
+     *
+     * @param start ros::Time with the desired time stamp.
+     */
+    void setStart(const ros::Time& start);
+
+    /**
+     * @brief Sets the time stamp for the end of the bag.
+     *
+     * @param end ros::Time with the desired time stamp.
+     */
+    void setEnd(const ros::Time& end);
+
+    /**
+     * @brief Changes the playback speed.
+     *
+     * @param change Float with the value to increase or decrease
+     *        the playback speed.
+     */
+    void changeSpeed(const float change);
+
+    /**
+     * @brief Sets the playback speed.
+     *
+     * @param speed Double with the new playback speed, negative to
+     *        play backwards. Zero is ignored.
+     */
+    void setSpeed(const double speed);
+
+    /**
+     * @brief Enables or disables the playback as fast as possible,
+     *        publishing every message as soon as it is read instead of
+     *        at its time stamp.
+     *
+     * @param enable Bool set to true to play unthrottled.
+     */
+    void setUnthrottled(const bool enable);
+
+    /**
+     * @brief Pauses the playback, if it is playing.
+     */
+    void pause(void);
+
+    /**
+     * @brief Starts playing the loaded rosbags, if they are not being
+     *        played already.
+     */
+    void play(void);
+
+    /**
+     * @brief Moves the playhead to the beginning of the A/B range.
+     */
+    void gotoBegin(void);
+
+    /**
+     * @brief Moves the playhead to the end of the A/B range.
+     */
+    void gotoEnd(void);
+
+    /**
+     * @brief Moves the playhead to a time stamp, inside the A/B range,
+     *        publishing the seek snapshot. The playback goes on from
+     *        there if it is playing.
+     *
+     * @param stamp ros::Time with the time stamp to seek to.
+     */
+    void seek(const ros::Time& stamp);
+
+    /**
+     * @brief Moves the playhead to a fraction of the bags, see seek().
+     *
+     * @param progress Double with the value [0, 1] from the progress bar.
+     */
+    void seekProgress(const double progress);
+
+    /**
+     * @brief Selects the topics to play. The messages of the other
+     *        topics are neither read nor published.
+     *
+     * @param topics std::vector<std::string> with the names of the
+     *        selected topics.
+     */
+    void selectTopics(const std::vector<std::string>& topics);
+
+    /**
+     * @brief Restricts the density sent to the listener to a single
+     *        topic, played or not. It is cleared when bags are loaded.
+     *
+     * @param topic std::string with the name of the topic, empty for
+     *        all the selected topics.
+     */
+    void setDensityTopic(const std::string& topic);
+
+    /**
+     * @brief Steps through the messages of a topic, pausing the
+     *        playback. Stepping forward publishes every selected
+     *        message up to the message stepped to, stepping backwards
+     *        publishes the messages at its time stamp.
+     *
+     * @param topic std::string with the topic to step through.
+     * @param count Int with the number of messages of the topic to
+     *        step, negative to step backwards.
+     */
+    void step(const std::string& topic, const int count);
+
+    /**
+     * @brief Sets the start of the A/B range at the playhead, or moves
+     *        it back to the beginning of the bag.
+     *
+     * @param enable Bool set to true to set the start at the playhead.
+     */
+    void setRangeStart(const bool enable);
+
+    /**
+     * @brief Sets the end of the A/B range at the playhead, or moves it
+     *        back to the end of the bag.
+     *
+     * @param enable Bool set to true to set the end at the playhead.
+     */
+    void setRangeEnd(const bool enable);
+
+    /**
+     * @brief Sets the queue sizes and the topic prefix of the publishers,
+     *        advertising the selected topics again. The playback goes on
+     *        from the playhead if it is playing.
+     *
+     * @param options PublisherOptions with the new options.
+     */
+    void setPublisherOptions(const PublisherOptions& options);
+
+    /**
+     * @brief Returns the options of the publishers, set by the queue_size
+     * and topic_prefix parameters until setPublisherOptions() is called.
+     */
+    const PublisherOptions& publisherOptions(void) const { return _publisher_options; }
+
+    /**
+     * @brief Sets the maximum size of the decompressed chunks kept to
+     *        seek back around, dropping the oldest ones if it shrinks.
+     *        The playback goes on from the playhead if it is playing.
+     *
+     * @param megabytes Double with the size in MB, 0 to keep none.
+     */
+    void setChunkCacheSize(const double megabytes);
+
+    /**
+     * @brief Returns the maximum size in MB of the chunk cache, set by the
+     * chunk_cache_mb parameter until setChunkCacheSize() is called.
+     */
+    double chunkCacheSize(void) const { return _chunk_cache_mb; }
+
+    /**
+     * @brief Sets the A/B range, such as a range saved with a session,
+     *        clamped to the bags, and restarts the playback inside the
+     *        new range if it is playing. A range outside of the bags is
+     *        ignored.
+     *
+     * @param start ros::Time with the first time stamp of the range.
+     * @param end ros::Time with the last time stamp of the range.
+     */
+    void setRange(const ros::Time& start, const ros::Time& end);
+
+    /**
+     * @brief Exports the messages of the selected topics in the A/B
+     *        range into a new rosbag, on a background thread, while the
+     *        playback goes on. Only the chunks of the range that hold
+     *        selected messages are read, using the indexes. The export
+     *        is cancelled if other bags are loaded.
+     *
+     * @param filename std::string with the absolute path of the new
+     *        rosbag, which is overwritten.
+     *
+     * @return bool set to false if no bag is loaded, an export is
+     *         already running or the bags can not be read, reported
+     *         to the listener as a status text.
+     */
+    bool exportRange(const std::string& filename);
+
+    /**
+     * @brief Plays the A/B range in a loop, reading it again from the
+     *        indexes and the chunk cache on every pass.
+     *
+     * @param enable Bool set to true to loop.
+     */
+    void setLoop(const bool enable);
+
+    /**
+     * @brief Sends the playhead state to the listener if it changed
+     * since it was last sent, and publishes the diagnostics when they
+     * are due. To be called periodically from the thread of the
+     * commands, at uiUpdateRate(); does nothing until bags are loaded.
+     */
+    void update(void);
+
+    /**
+     * @brief Returns the frequency at which update() is expected to be
+     * called, set by the ui_update_rate parameter.
+     */
+    double uiUpdateRate(void) const { return _ui_update_rate; }
+
+    /**
+     * @brief Returns true if the playback has been requested and is
+     * not finished.
+     */
+    bool isPlaying(void);
+
+  private:
+    /**
+     * @brief Topics whose last message before the playhead is published
+     * again after a seek.
+     */
+    enum class SeekSnapshot
+    {
+        None,
+        Latched,
+        All
+    };
+
+    /**
+     * @brief Published totals of a bag connection, for the diagnostics.
+     */
+    struct ConnectionStatistics
+    {
+        std::atomic<uint64_t> messages{0};
+        std::atomic<uint64_t> bytes{0};
+    };
+
+    /**
+     * @brief Publisher of a bag connection, resolved once at load.
+     */
+    struct ConnectionPublisher
+    {
+        ros::Publisher*               publisher{nullptr};
+        const rosbag::ConnectionInfo* connection{nullptr};
+        bool                          droppable{false}; // Dropped when later than the lateness budget
+    };
+
+    /**
+     * @brief Playback settings and clock, changed by the slots and read
+     * by the play and clock threads for every message without locking.
+     *
+     * The simulated time is the anchor time stamp, moved by the steady
+     * time elapsed since play_start at the playback speed.
+     *
+     * The control time stamps bound the current playback, inside the
+     * A/B range, which is the whole bag unless the user sets it.
+     */
+    struct PlaybackState
+    {
+        double                                speed{1.0}; // Negative while playing backwards
+        bool                                  unthrottled{false};
+        bool                                  direction_changed{false};
+        ros::Time                             control_start;
+        ros::Time                             control_end;
+        ros::Time                             range_start;
+        ros::Time                             range_end;
+        bool                                  loop{false}; // The range is played again when it is over
+        ros::Time                             anchor;
+        std::chrono::steady_clock::time_point play_start;
+        bool                                  running{false}; // False while paused, the clock holds the anchor
+    };
+
+    /**
+     * @brief Loop of the play thread, which lives as long as the
+     * player: it waits for a play command and plays until the bag is
+     * finished or a command stops it.
+     */
+    void work(void);
+
+    /**
+     * @brief Plays the bag, forward or backwards, until it is finished,
+     * paused or restarted.
+     *
+     * @param restart Bool set to true to read the bag again from the
+     *        control time stamps, or false to resume from the messages
+     *        already read ahead.
+     */
+    void playBag(const bool restart);
+
+    /**
+     * @brief Restarts the read-ahead from the control time stamps and
+     * anchors the playback clock there.
+     *
+     * @return bool set to false if the bag can not be played in the
+     *         current direction yet.
+     */
+    bool startReading(void);
+
+    /**
+     * @brief Stops the playback at the end of the bag, reporting the
+     * read error if any, and rewinds the controls.
+     */
+    void finishPlayback(void);
+
+    /**
+     * @brief Background stage of the bag loading: indexes every
+     * message of the bags without a sidecar index, one bag after the
+     * other, reporting the progress, and enables the seek controls
+     * once done.
+     */
+    void buildIndexes(void);
+
+    /**
+     * @brief Marks the bags left to index as complete when the indexing
+     * stops early, so the player does not wait for them forever.
+     *
+     * @param building std::vector<std::size_t> with the bags to index.
+     * @param first std::size_t with the position of the first bag left.
+     */
+    void stopBuilding(const std::vector<std::size_t>& building, const std::size_t first);
+
+    /**
+     * @brief Cancels the background indexing of the current bag,
+     * if any, and waits for it to finish.
+     */
+    void cancelLoad(void);
+
+    /**
+     * @brief Loop of the export thread: writes the messages read by the
+     * export prefetcher into the new rosbag, reporting the progress,
+     * and removes the rosbag if the export fails or is cancelled.
+     *
+     * @param filename std::string with the path of the new rosbag.
+     * @param start ros::Time with the first time stamp of the range.
+     * @param end ros::Time with the last time stamp of the range.
+     */
+    void exportMessages(const std::string filename, const ros::Time start, const ros::Time end);
+
+    /**
+     * @brief Cancels the running export, if any, and waits for it to
+     * finish.
+     */
+    void cancelExport(void);
+
+    /**
+     * @brief Returns the publisher of a connection, or nullptr if its
+     * topic is not played.
+     */
+    const ConnectionPublisher* connectionPublisher(const uint32_t connection_id) const;
+
+    /**
+     * @brief Waits until a message is due, or, while playing
+     * unthrottled, until its publisher has the minimum number of
+     * subscribers set by the unthrottled_min_subscribers parameter.
+     * Any command wakes the wait up, and speed changes move the
+     * deadline.
+     *
+     * @param message PrefetchedMessage with the read-ahead message.
+     * @param lateness_nsec Int64 set to how late the message is, in
+     *        nanoseconds. Always 0 while playing unthrottled.
+     *
+     * @return bool set to false if the playback has been stopped
+     *         while waiting.
+     */
+    bool waitForMessage(const PrefetchedMessage& message, int64_t& lateness_nsec);
+
+    /**
+     * @brief Returns true if a message may be dropped when it is later
+     * than the lateness_budget parameter: its topic is one of the
+     * drop_topics, or drop_topics is empty.
+     */
+    bool isDroppable(const PrefetchedMessage& message) const;
+
+    /**
+     * @brief Adds the lateness of a due message to the maximum
+     * lateness and to the lateness histogram.
+     *
+     * @param lateness_nsec Int64 with the lateness in nanoseconds.
+     */
+    void recordLateness(const int64_t lateness_nsec);
+
+    /**
+     * @brief Publishes the data of a message on the publisher of its
+     * connection, if it is selected, and adds it to the published
+     * totals and to the time spent publishing.
+     *
+     * @param connection_id uint32_t with the set-wide connection id.
+     * @param data MessageData with the serialized message.
+     *
+     * @return bool set to false if the connection has no publisher.
+     */
+    bool publishData(const uint32_t connection_id, const MessageData& data);
+
+    /**
+     * @brief Publishes a message and moves the playhead to it.
+     *
+     * @param message PrefetchedMessage with the read-ahead message.
+     */
+    void publishMessage(const PrefetchedMessage& message);
+
+    /**
+     * @brief Starts the playback clock, and the /clock thread, if it is
+     * not running yet.
+     *
+     * @param next_stamp ros::Time with the time stamp of the first
+     *        message to publish.
+     */
+    void startClock(const ros::Time& next_stamp);
+
+    /**
+     * @brief Stops the playback clock at the current simulated time,
+     * and the /clock thread.
+     */
+    void stopClock(void);
+
+    /**
+     * @brief Stops the playback and waits for the play thread to be
+     * idle, in well under a frame.
+     *
+     * @param restart Bool set to true to read the bag again on the
+     *        next play, or false to pause, resuming from the messages
+     *        already read ahead.
+     */
+    void stopPlayback(const bool restart);
+
+    /**
+     * @brief Makes the playback restart from the control time stamps:
+     * right away if it is playing, otherwise on the next play.
+     */
+    void requestRestart(void);
+
+    /**
+     * @brief Wakes the play thread up if it is waiting for a message,
+     * so it picks up a speed or mode change.
+     */
+    void interruptWait(void);
+
+    /**
+     * @brief Returns true if a command stops the current playback.
+     */
+    bool isInterrupted(void) const;
+
+    /**
+     * @brief Returns the time stamp of the last published message, or
+     * of the last seek.
+     */
+    ros::Time lastMessageTime(void) const;
+
+    /**
+     * @brief Finds the time stamp of the message of a topic that is
+     * a number of messages of that topic away from a time stamp, using
+     * the indexes of every bag.
+     *
+     * @param topic std::string with the topic to step through.
+     * @param from ros::Time with the time stamp to step from.
+     * @param count Int with the number of messages of the topic to
+     *        step, negative to step backwards.
+     * @param inclusive Bool set to true if a message at from counts as
+     *        the first step, when nothing has been played yet.
+     * @param target ros::Time set to the time stamp of the message
+     *        stepped to.
+     *
+     * @return bool set to false if there is no message of the topic
+     *         in that direction.
+     */
+    bool findStep(
+            const std::string& topic,
+            const ros::Time&   from,
+            const int          count,
+            const bool         inclusive,
+            ros::Time&         target) const;
+
+    /**
+     * @brief Publishes the last message before a time stamp of every
+     * selected connection, or of the latched ones only, in time stamp
+     * order, so the subscribers get the state of the bag at a seek
+     * without replaying it from the start. Must be called while the
+     * playback is stopped.
+     *
+     * @param stamp ros::Time with the time stamp seeked to.
+     */
+    void publishSnapshot(const ros::Time& stamp);
+
+    /**
+     * @brief Advertises the selected topics, shuts down the publishers
+     * of the unselected ones and restricts the read-ahead to the
+     * connections of the selected topics.
+     */
+    void advertiseSelectedTopics(void);
+
+    /**
+     * @brief Returns the publisher queue size of a topic of the bags.
+     *
+     * @param topic std::string with the topic in the bags.
+     */
+    uint32_t queueSize(const std::string& topic) const;
+
+    /**
+     * @brief Create a ros::AdvertiseOptions object to create
+     * a publisher for the given topic.
+     *
+     * @param c rosbag::ConnectionInfo to check if the topic is
+     *          latching its messages.
+     * @param queue_size uint32_t with the size of the queue for
+     *        the ros publisher.
+     * @param prefix std::string with an optional prefix for the
+     *        topic to publish to.
+     *
+     * @return ros::AdvertiseOptions with all the given info.
+     */
+    ros::AdvertiseOptions createAdvertiseOptions(
+            const rosbag::ConnectionInfo* c,
+            uint32_t                      queue_size,
+            const std::string&            prefix);
+
+    /**
+     * @brief Checks if latch was true or false for a topic.
+     *
+     * @param c rosbag::ConnectionInfo to check if the topic is
+     *          latching its messages.
+     *
+     * @return bool with the value of the latching option.
+     */
+    bool isLatching(const rosbag::ConnectionInfo* c);
+
+    /**
+     * @brief Converts the size of a rosbag into
+     * {"B", "KB", "MB", "GB", "TB", "PB", "EB", "ZB", "YB"}.
+     *
+     * @param size uint64_t with the size of the rosbag.
+     *
+     */
+    void sizeToStr(const uint64_t size);
+
+    /**
+     * @brief Resets some variables to restart bag replay.
+     */
+    void reset(void);
+
+    /**
+     * @brief Resets all UI text labels.
+     */
+    void resetTxt(void);
+
+    /**
+     * @brief Sends the playhead state to the listener if it changed
+     * since it was last sent.
+     */
+    void publishPlayheadState(void);
+
+    /**
+     * @brief Publishes the playback statistics since the last call on
+     * /diagnostics, at the diagnostics_rate parameter frequency: time
+     * spent reading, decompressing and publishing, lateness, and the
+     * published rates of every selected topic. Runs on the player
+     * thread, called by update().
+     */
+    void publishDiagnostics(void);
+
+    /**
+     * @brief Publishes the simulated time on /clock at the clock_rate
+     * parameter frequency, while playing forward. Runs on the clock
+     * thread.
+     *
+     * The clock follows the playback speed, never goes past the next
+     * message to publish, and never goes back during a playback: it
+     * only jumps back when the playback restarts from an earlier time
+     * stamp (a seek or a loop). It is not published while playing
+     * backwards, so it holds the last value.
+     */
+    void publishClock(void);
+
+    /**
+     * @brief Returns the simulated time of the playback: the anchor
+     * time stamp, moved by the time elapsed since the anchor at the
+     * playback speed.
+     *
+     * @param state PlaybackState with the playback clock.
+     */
+    ros::Time simTime(const PlaybackState& state) const;
+
+    /**
+     * @brief Moves the anchor of the playback clock to the current
+     * simulated time, before the speed or the mode changes.
+     *
+     * @param state PlaybackState with the playback clock to modify.
+     */
+    void reanchorClock(PlaybackState& state) const;
+
+    /**
+     * @brief Calculate the steady time to wait until a message
+     * is due. The playback is scheduled on the steady clock, so it
+     * does not depend on the published /clock.
+     *
+     * @param state PlaybackState with the playback clock.
+     * @param msg_time ros::Time with the time stamp of the message.
+     *
+     * @return std::chrono::steady_clock::time_point to wait until.
+     */
+    static std::chrono::steady_clock::time_point real_time(const PlaybackState& state, const ros::Time& msg_time);
+
+    /**
+     * @brief Sends the current playback speed and mode to the listener.
+     */
+    void publishPlaybackSpeed(void);
+
+    /**
+     * @brief Calculate the time stamp to start playing from
+     * the clicked progress bar value.
+     *
+     * @param progress Double value of the progress bar [0, 1]
+     *
+     * @return ros::Time with the calculated time stamp.
+     */
+    ros::Time getProgressTime(const double progress);
+
+    /**
+     * @brief Computes the density of the selected topics, or of the
+     * density topic, from the indexes and sends it to the listener.
+     */
+    void publishTimelineDensity(void);
+
+    Listener  _no_listener;
+    Listener* _listener;
+
+    ros::NodeHandle   _nh;
+    BagSet            _bags;
+    MessagePrefetcher _prefetcher;
+
+    // Publishers by topic, and looked up by connection id while playing
+    std::map<std::string, ros::Publisher> _pubs;
+    std::vector<ConnectionPublisher>      _connection_pubs;
+    std::set<std::string>                 _selected_topics;
+    PublisherOptions                      _publisher_options;
+    double                                _chunk_cache_mb{256.0};
+    std::thread                           _play_thread;
+    std::thread                           _load_thread;
+    std::atomic<bool>                     _cancel_load{false};
+
+    // Excerpts are read by their own prefetcher, with their own file descriptors
+    std::unique_ptr<MessagePrefetcher> _exporter;
+    std::thread                        _export_thread;
+    std::atomic<bool>                  _exporting{false};
+    std::atomic<bool>                  _cancel_export{false};
+    std::string                        _export_compression{"none"};
+    int                                _decode_threads{0};
+    bool                               _mmap_bags{false};
+
+    // The play loop only stores the playhead, which is sent to the listener by update()
+    bool                  _loaded{false};
+    bool                  _density_outdated{false};
+    std::string           _density_topic; // Empty for all the selected topics
+    double                _ui_update_rate{30.0};
+    std::atomic<uint64_t> _playhead_nsec{0};
+    uint64_t              _published_playhead_nsec{0};
+    std::atomic<int64_t>  _max_lateness_nsec{0};
+
+    // Late messages over the budget are dropped on the droppable topics, 0 to never drop
+    int64_t                                          _lateness_budget_nsec{0};
+    std::set<std::string>                            _drop_topics;
+    std::array<std::atomic<uint64_t>, LATENESS_BINS> _lateness_histogram{};
+    std::atomic<uint64_t>                            _dropped_messages{0};
+    uint64_t                                         _published_dropped_messages{0};
+
+    // Published totals, turned into rates by the telemetry timer over short windows
+    std::atomic<uint64_t>                 _published_messages{0};
+    std::atomic<uint64_t>                 _published_bytes{0};
+    std::chrono::steady_clock::time_point _rate_window_start;
+    uint64_t                              _rate_window_messages{0};
+    uint64_t                              _rate_window_bytes{0};
+    double                                _message_rate{0.0};
+    double                                _byte_rate{0.0};
+    double                                _read_rate{0.0};
+    double                                _read_load{0.0};
+    double                                _decode_load{0.0};
+    double                                _publish_load{0.0};
+    std::atomic<uint64_t>                 _publish_nsec{0};
+    uint64_t                              _rate_window_publish_nsec{0};
+    ChunkStatistics                       _rate_window_chunks;
+
+    // Published totals by set-wide connection id, and totals at the last diagnostics
+    std::vector<ConnectionStatistics>     _connection_statistics;
+    ros::Publisher                        _diagnostics_pub;
+    bool                                  _publish_diagnostics{false};
+    double                                _diagnostics_rate{1.0};
+    std::chrono::steady_clock::time_point _diagnostics_window_start;
+    std::atomic<int64_t>                  _diagnostics_max_lateness_nsec{0};
+    uint64_t                              _diagnostics_window_messages{0};
+    uint64_t                              _diagnostics_window_bytes{0};
+    uint64_t                              _diagnostics_window_publish_nsec{0};
+    uint64_t                              _diagnostics_window_dropped{0};
+    ChunkStatistics                       _diagnostics_window_chunks;
+    std::vector<uint64_t>                 _diagnostics_window_connection_messages;
+    std::vector<uint64_t>                 _diagnostics_window_connection_bytes;
+
+    ros::Time              _full_bag_start, _full_bag_end;
+    ros::Time              _published_range_start, _published_range_end;
+    bool                   _published_loop{false};
+    std::atomic<uint64_t>  _last_message_nsec{0};
+    std::atomic<bool>      _played{false}; // False until a message is played or the playhead is placed
+    SeqLock<PlaybackState> _playback;
+
+    // Simulated time, published on /clock while playing forward
+    ros::Publisher        _clock_pub;
+    std::thread           _clock_thread;
+    std::atomic<bool>     _clock_running{false};
+    bool                  _publish_clock{false};
+    double                _clock_rate{100.0};
+    std::atomic<uint64_t> _next_stamp_nsec{0};
+    ros::Time             _clock_time;
+
+    int _unthrottled_min_subscribers{0};
+
+    SeekSnapshot _seek_snapshot{SeekSnapshot::All};
+
+    // Commands to the play thread, changed with _command_mutex locked and read without locking
+    std::mutex              _command_mutex;
+    std::condition_variable _command_cv;
+    std::condition_variable _idle_cv;
+    std::atomic<bool>       _play_requested{false};
+    std::atomic<bool>       _restart{true};
+    std::atomic<bool>       _quit{false};
+    bool                    _idle{false};
+    std::atomic<uint64_t>   _command_id{0};
+
+    // Message read ahead and not published yet, kept while paused
+    const PrefetchedMessage* _held_message{nullptr};
+};
+
+} // namespace rosbag_rviz_panel
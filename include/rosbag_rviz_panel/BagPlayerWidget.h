@@ -1,6 +1,8 @@
 #pragma once
 
+#include <QAction>
 #include <QList>
+#include <QMenu>
 #include <QThread>
 #include <QWidget>
 
@@ -13,6 +15,22 @@ class BagPlayerWidget;
 
 namespace rosbag_rviz_panel {
 
+/**
+ * @brief Configuration and last session of the player, saved in the
+ * panel configuration and restored when it is loaded.
+ */
+struct PlayerSession
+{
+    QStringList bags;                 // Absolute paths or URLs of the bags played together
+    bool        all_topics{true};     // True if every topic is selected, so new topics are played too
+    QStringList topics;               // Selected topics if not all of them are, possibly none
+    double      speed{1.0};           // Playback speed, negative to play backwards
+    bool        loop{false};          // True if the range is played in a loop
+    ros::Time   range_start;          // A/B range, zero for the edge of the bags
+    ros::Time   range_end;
+    double      chunk_cache_mb{-1.0}; // Maximum size of the chunk cache, 0 to disable it, negative to keep it
+};
+
 /**
  * @brief BagPlayerWidget.
  *
@@ -37,7 +55,54 @@ class BagPlayerWidget : public QWidget
      */
     virtual ~BagPlayerWidget();
 
+    /**
+     * @brief Returns the options of the publishers, to save them in
+     * the panel configuration.
+     */
+    const PublisherOptions& publisherOptions(void) const { return _publisher_options; }
+
+    /**
+     * @brief Sets the options of the publishers, such as the ones loaded
+     * from the panel configuration, and sends them to the player.
+     *
+     * @param options PublisherOptions with the new options.
+     */
+    void setPublisherOptions(const PublisherOptions& options);
+
+    /**
+     * @brief Returns the configuration and the last session of the
+     * player, to save them in the panel configuration.
+     */
+    PlayerSession session(void) const;
+
+    /**
+     * @brief Restores a session, such as the one loaded from the panel
+     * configuration. The chunk cache size is sent right away, the bags
+     * are loaded if requested, and the topics, the speed, the range and
+     * the loop are applied once their topics are received.
+     *
+     * @param session PlayerSession with the session to restore.
+     * @param auto_load Bool set to true to load the bags of the session,
+     *        skipping the ones that no longer exist.
+     */
+    void restoreSession(const PlayerSession& session, const bool auto_load);
+
   private:
+    /**
+     * @brief Function that applies the topics, the speed, the range and
+     * the loop of the session being restored to the loaded bags.
+     */
+    void applySession(void);
+
+    /**
+     * @brief Function that loads bags chosen by the user, replacing the
+     * session being restored.
+     *
+     * @param filenames QStringList with the absolute file paths or the
+     *        URLs of the bags.
+     */
+    void loadBags(const QStringList& filenames);
+
     /**
      * @brief Function that emits the signal to start
      * playing the loaded rosbag.
@@ -59,12 +124,12 @@ class BagPlayerWidget : public QWidget
 
   Q_SIGNALS:
     /**
-     * @brief Q_SIGNAL that sends the absolute file path
-     * of the rosbag.
+     * @brief Q_SIGNAL that sends the absolute file paths
+     * of the rosbags to play together.
      *
-     * @param file QString that contains the bag path.
+     * @param files QStringList that contains the bag paths.
      */
-    void sendLoadBag(const QString file);
+    void sendLoadBags(const QStringList files);
 
     /**
      * @brief Q_SIGNAL that starts the rosbag playing.
@@ -108,6 +173,91 @@ class BagPlayerWidget : public QWidget
      */
     void sendSlower(const float value);
 
+    /**
+     * @brief Q_SIGNAL that sets the playback speed.
+     *
+     * @param speed Double with the desired playback speed,
+     *        negative to play backwards.
+     */
+    void sendSetSpeed(const double speed);
+
+    /**
+     * @brief Q_SIGNAL that enables or disables the playback
+     * as fast as possible.
+     *
+     * @param enable Bool set to true to play without waiting
+     *        for the message time stamps.
+     */
+    void sendSetUnthrottled(const bool enable);
+
+    /**
+     * @brief Q_SIGNAL that sends the topics selected to be played.
+     *
+     * @param topics QStringList with the selected topic names.
+     */
+    void sendSelectTopics(const QStringList topics);
+
+    /**
+     * @brief Q_SIGNAL that steps through the messages of a topic.
+     *
+     * @param topic QString with the topic to step through.
+     * @param count Int with the number of messages of the topic to
+     *        step, negative to step backwards.
+     */
+    void sendStep(const QString topic, const int count);
+
+    /**
+     * @brief Q_SIGNAL that sets or clears the start of the A/B range.
+     *
+     * @param enable Bool set to true to set it at the playhead.
+     */
+    void sendSetRangeStart(const bool enable);
+
+    /**
+     * @brief Q_SIGNAL that sets or clears the end of the A/B range.
+     *
+     * @param enable Bool set to true to set it at the playhead.
+     */
+    void sendSetRangeEnd(const bool enable);
+
+    /**
+     * @brief Q_SIGNAL that enables or disables the loop playback.
+     *
+     * @param enable Bool set to true to play the range in a loop.
+     */
+    void sendSetLoop(const bool enable);
+
+    /**
+     * @brief Q_SIGNAL that sets the queue sizes and the topic prefix of
+     * the publishers.
+     *
+     * @param options PublisherOptions with the new options.
+     */
+    void sendSetPublisherOptions(const PublisherOptions options);
+
+    /**
+     * @brief Q_SIGNAL that sets the A/B range.
+     *
+     * @param start ros::Time with the first time stamp of the range.
+     * @param end ros::Time with the last time stamp of the range.
+     */
+    void sendSetRange(const ros::Time start, const ros::Time end);
+
+    /**
+     * @brief Q_SIGNAL that sets the maximum size of the chunk cache.
+     *
+     * @param megabytes Double with the size in MB.
+     */
+    void sendSetChunkCacheSize(const double megabytes);
+
+    /**
+     * @brief Q_SIGNAL that exports the selected topics in the A/B range
+     * into a new bag.
+     *
+     * @param filename QString with the absolute path of the new bag.
+     */
+    void sendExportRange(const QString filename);
+
   private Q_SLOTS:
     /**
      * @brief Q_SLOT that handles actions for when
@@ -136,6 +286,73 @@ class BagPlayerWidget : public QWidget
      */
     void handleLoadClicked(void);
 
+    /**
+     * @brief Q_SIGNAL that handles actions for when
+     * the remote load button has been clicked.
+     */
+    void handleUrlClicked(void);
+
+    /**
+     * @brief Q_SLOT that pauses the playback and steps through the
+     * messages of the selected step topic.
+     *
+     * @param forward Bool set to true to step forward, or false to
+     *        step backwards.
+     */
+    void handleStepClicked(const bool forward);
+
+    /**
+     * @brief Q_SLOT that sends the checked topics of the topics
+     * menu and updates the topics button text.
+     */
+    void handleTopicsChanged(void);
+
+    /**
+     * @brief Q_SLOT that checks or unchecks all the topics of
+     * the topics menu.
+     *
+     * @param checked Bool set to true to select all the topics.
+     */
+    void handleSelectAllTopics(const bool checked);
+
+    /**
+     * @brief Q_SLOT that opens the dialog to edit the options of the
+     * publishers, and sends them if they are accepted.
+     */
+    void handlePublishersClicked(void);
+
+    /**
+     * @brief Q_SLOT that asks for the path of the new bag and sends the
+     * export of the A/B range.
+     */
+    void handleExportClicked(void);
+
+    /**
+     * @brief Q_SLOT that shows the progress of an export in the status
+     * bar, the export button being disabled until it is over.
+     *
+     * @param progress Int value [0, 100] with the exported percentage.
+     */
+    void receiveExportProgress(const int progress);
+
+    /**
+     * @brief Q_SLOT that shows the density of the selected topics in the
+     * heat strip of the progress bar.
+     *
+     * @param density TimelineDensity with the density, empty to clear it.
+     */
+    void receiveTimelineDensity(const TimelineDensity density);
+
+    /**
+     * @brief Q_SLOT that fills the topics menu with the topics
+     * of the loaded bag, all of them checked, and the step topic
+     * box, then applies the session being restored, if any.
+     *
+     * @param topics QStringList with the topic names, empty to
+     *        clear the menu.
+     */
+    void receiveTopics(const QStringList topics);
+
     /**
      * @brief Q_SLOT that gets the total size of the bag.
      *
@@ -152,43 +369,48 @@ class BagPlayerWidget : public QWidget
     void receiveStatusText(const QString text);
 
     /**
-     * @brief Q_SLOT that receives the actual stamp time.
+     * @brief Q_SLOT that receives the current playhead location and
+     * updates the time stamp, date and seconds labels, the
+     * progress bar and its A/B range, the throughput label and the
+     * read-ahead metrics tooltip.
      *
-     * @param stamp QString that contains the time stamp.
+     * @param state PlayheadState with the playhead and bag time stamps,
+     *        or an invalid state to clear the labels.
      */
-    void receiveStampLabel(const QString stamp);
+    void receivePlayheadState(const PlayheadState state);
 
     /**
-     * @brief Q_SLOT that gets the actual stamp in a human-readable
-     * date, in a QString.
+     * @brief Q_SLOT that gets the playback speed and mode.
      *
-     * @param date QString that contains the time stamp in a
-     *        human-redable format.
+     * @param speed Double with the actual playback speed, or 0 to clear it.
+     * @param unthrottled Bool set to true if the messages are played as
+     *        fast as possible.
      */
-    void receiveDateLabel(const QString date);
+    void receivePlaybackSpeed(const double speed, const bool unthrottled);
 
     /**
-     * @brief Q_SLOT that gets the playback speed.
+     * @brief Q_SLOT that enables or disables the action buttons.
      *
-     * @param speed QString that contains the actual playback speed.
+     * @param enable Bool to enable or disable all action buttons.
      */
-    void receivePlayspeedLabel(const QString speed);
+    void receiveEnableActionButtons(const bool enable);
 
     /**
-     * @brief Q_SLOT that receives the number of seconds the current
-     * playhead location is from the beginning of the bag.
+     * @brief Q_SLOT that enables or disables the controls that
+     * need the whole bag to be indexed.
      *
-     * @param seconds QString that contains the current playhead location
-     *        in seconds.
+     * @param enable Bool to enable or disable the progress bar and the
+     *        begin, end, slower and step buttons.
      */
-    void receiveSecondsLabel(const QString seconds);
+    void receiveEnableSeekControls(const bool enable);
 
     /**
-     * @brief Q_SLOT that enables or disables the action buttons.
+     * @brief Q_SLOT that shows the loading progress of the bag in
+     * the status bar.
      *
-     * @param enable Bool to enable or disable all action buttons.
+     * @param progress Int value [0, 100] with the loading progress.
      */
-    void receiveEnableActionButtons(const bool enable);
+    void receiveLoadProgress(const int progress);
 
     /**
      * @brief Q_SLOT to reset the play button.
@@ -201,5 +423,19 @@ class BagPlayerWidget : public QWidget
     std::unique_ptr<QBagPlayer>         _player;
     std::unique_ptr<QThread>            _player_thread;
     std::unique_ptr<QCustomProgressBar> _progress_bar;
+    std::unique_ptr<QMenu>              _topics_menu;
+    QList<QAction*>                     _topic_actions;
+    PublisherOptions                    _publisher_options;
+
+    // Last loaded bags and A/B range, zero for the edge of the bags
+    QStringList _bags;
+    ros::Time   _range_start;
+    ros::Time   _range_end;
+    double      _chunk_cache_mb{0.0};
+    bool        _exporting{false};
+
+    // Session applied once the topics of its bags are received
+    PlayerSession _pending_session;
+    bool          _session_pending{false};
 };
 } // namespace rosbag_rviz_panel
\ No newline at end of file
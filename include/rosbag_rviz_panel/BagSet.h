@@ -0,0 +1,129 @@
+#pragma once
+
+#include <ros/time.h>
+#include <rosbag/structures.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BagIndex.h"
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief BagSet.
+ *
+ * Set of rosbags played as one timeline, such as the per-sensor or
+ * split-by-size files of a recording, each with its own BagIndex.
+ *
+ * The connection ids of the bags overlap, so every connection gets a
+ * set-wide id: the id in its bag plus the connection base of the bag.
+ *
+ */
+class BagSet
+{
+  public:
+    /**
+     * @brief Connection of one of the bags, by set-wide id.
+     */
+    struct Connection
+    {
+        std::size_t                   bag{0};
+        const rosbag::ConnectionInfo* info{nullptr};
+    };
+
+    /**
+     * @brief Constructor of the BagSet class.
+     */
+    BagSet() = default;
+
+    BagSet(const BagSet&)            = delete;
+    BagSet& operator=(const BagSet&) = delete;
+
+    /**
+     * @brief Adds a rosbag to the set, mapping its sidecar index if it
+     * is still up to date, or reading its index section otherwise, in
+     * which case its messages are indexed later by BagIndex::build().
+     *
+     * @param filename std::string with the absolute file path of
+     *        the rosbag.
+     *
+     * @return bool set to true if the sidecar index was mapped.
+     *
+     * @throws rosbag::BagException if the file can not be read or
+     *         it is not an indexed V2.0 bag.
+     */
+    bool add(const std::string& filename);
+
+    /**
+     * @brief Removes every bag from the set.
+     */
+    void clear(void);
+
+    /**
+     * @brief Returns the number of bags in the set.
+     */
+    std::size_t size(void) const { return _indexes.size(); }
+
+    /**
+     * @brief Returns true if the set has no bags.
+     */
+    bool empty(void) const { return _indexes.empty(); }
+
+    /**
+     * @brief Returns the index of a bag.
+     */
+    BagIndex& index(const std::size_t bag) { return *_indexes[bag]; }
+
+    /**
+     * @brief Returns the index of a bag.
+     */
+    const BagIndex& index(const std::size_t bag) const { return *_indexes[bag]; }
+
+    /**
+     * @brief Returns the absolute file path of a bag.
+     */
+    const std::string& filename(const std::size_t bag) const { return _filenames[bag]; }
+
+    /**
+     * @brief Returns the set-wide id of the first connection id of a bag.
+     */
+    uint32_t connectionBase(const std::size_t bag) const { return _connection_bases[bag]; }
+
+    /**
+     * @brief Returns the connections of every bag, indexed by set-wide
+     * id. The ids that no connection uses have a null info.
+     */
+    const std::vector<Connection>& connections(void) const { return _connections; }
+
+    /**
+     * @brief Returns true while the messages of any bag are being
+     * indexed.
+     */
+    bool isBuilding(void) const;
+
+    /**
+     * @brief Returns the total size of the bag files, in bytes.
+     */
+    uint64_t fileSize(void) const;
+
+    /**
+     * @brief Returns the time stamp of the first message of the set.
+     */
+    ros::Time startTime(void) const;
+
+    /**
+     * @brief Returns the time stamp of the last message of the set.
+     */
+    ros::Time endTime(void) const;
+
+  private:
+    std::vector<std::unique_ptr<BagIndex>> _indexes;
+    std::vector<std::string>               _filenames;
+    std::vector<uint32_t>                  _connection_bases;
+    std::vector<Connection>                _connections;
+};
+
+} // namespace rosbag_rviz_panel
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <rosbag/exceptions.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief BagSource.
+ *
+ * Random access to the bytes of a rosbag, wherever it is stored. A
+ * local path is read with pread(), an http:// or https:// URL (e.g. a
+ * presigned URL of an object store) with HTTP range requests, so only
+ * the index and the chunks that are played are fetched.
+ *
+ * The remote reads go through a small cache of blocks, so the many
+ * small reads of the record headers cost a single request. Reads
+ * larger than a block, such as the chunks, are fetched as they are.
+ *
+ * Every method can be called from any thread.
+ *
+ */
+class BagSource
+{
+  public:
+    /**
+     * @brief Destructor of the BagSource class.
+     */
+    virtual ~BagSource() = default;
+
+    /**
+     * @brief Opens the source of a rosbag.
+     *
+     * @param location std::string with the absolute file path or the URL
+     *        of the rosbag.
+     *
+     * @return std::unique_ptr<BagSource> with the open source.
+     *
+     * @throws rosbag::BagIOException if the rosbag can not be opened.
+     */
+    static std::unique_ptr<BagSource> open(const std::string& location);
+
+    /**
+     * @brief Returns true if a location is a URL, read with range
+     * requests, and not a local path.
+     */
+    static bool isRemote(const std::string& location);
+
+    /**
+     * @brief Returns a location without the query of a URL, which may
+     * hold the credentials of a presigned URL, to show it or store it.
+     * A local path is returned as it is.
+     */
+    static std::string stripQuery(const std::string& location);
+
+    /**
+     * @brief Returns the size of the rosbag in bytes.
+     */
+    virtual uint64_t size(void) const = 0;
+
+    /**
+     * @brief Returns a text that changes whenever the rosbag is
+     * modified: its modification time for a file, its ETag or its
+     * Last-Modified date for a URL. Empty if the server sends neither.
+     */
+    virtual const std::string& version(void) const = 0;
+
+    /**
+     * @brief Returns the file descriptor of a local rosbag, to map it
+     * in memory, or -1 for a remote one.
+     */
+    virtual int fd(void) const { return -1; }
+
+    /**
+     * @brief Reads exactly len bytes at the given offset of the rosbag.
+     *
+     * @param offset uint64_t with the absolute position in the rosbag.
+     * @param dst Pointer to a buffer of at least len bytes.
+     * @param len std::size_t with the number of bytes to read.
+     *
+     * @throws rosbag::BagIOException if the rosbag is shorter than
+     *         requested or can not be read.
+     */
+    virtual void read(uint64_t offset, void* dst, std::size_t len) const = 0;
+};
+
+} // namespace rosbag_rviz_panel
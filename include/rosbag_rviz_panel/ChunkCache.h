@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+
+#include "ChunkReader.h"
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief ChunkCache.
+ *
+ * Least recently used decompressed chunks of a BagSet, bounded by
+ * their total size, so seeking back and forth around the playhead
+ * does not read and decompress the same chunks again.
+ *
+ * The chunks are shared with the messages that point into them, so a
+ * chunk evicted from the cache stays alive while a message holds it.
+ * Not thread-safe.
+ *
+ */
+class ChunkCache
+{
+  public:
+    /**
+     * @brief Constructor of the ChunkCache class.
+     */
+    ChunkCache() = default;
+
+    ChunkCache(const ChunkCache&)            = delete;
+    ChunkCache& operator=(const ChunkCache&) = delete;
+
+    /**
+     * @brief Sets the maximum total size of the cached chunks, evicting
+     * the least recently used ones if needed.
+     *
+     * @param max_bytes std::size_t with the maximum size in bytes, 0 to
+     *        disable the cache.
+     */
+    void setCapacity(const std::size_t max_bytes);
+
+    /**
+     * @brief Returns the maximum total size of the cached chunks.
+     */
+    std::size_t capacity(void) const { return _max_bytes; }
+
+    /**
+     * @brief Returns the total size of the cached chunks.
+     */
+    std::size_t bytes(void) const { return _bytes; }
+
+    /**
+     * @brief Looks a chunk up, making it the most recently used.
+     *
+     * @param bag std::size_t with the bag of the chunk in the set.
+     * @param chunk_id uint32_t with the chunk id in the bag index.
+     *
+     * @return Pointer to the chunk, valid until the next change of the
+     *         cache, or nullptr if it is not cached.
+     */
+    const ChunkData* find(const std::size_t bag, const uint32_t chunk_id);
+
+    /**
+     * @brief Adds a chunk as the most recently used, evicting the least
+     * recently used ones to make room. Chunks larger than the capacity
+     * and chunks mapped from the bag file are not cached.
+     *
+     * @param bag std::size_t with the bag of the chunk in the set.
+     * @param chunk_id uint32_t with the chunk id in the bag index.
+     * @param chunk ChunkData with the decompressed chunk.
+     */
+    void insert(const std::size_t bag, const uint32_t chunk_id, const ChunkData& chunk);
+
+    /**
+     * @brief Removes every chunk.
+     */
+    void clear(void);
+
+  private:
+    /**
+     * @brief Cached chunk, in the recency list.
+     */
+    struct Entry
+    {
+        uint64_t  key{0};
+        ChunkData chunk;
+    };
+
+    /**
+     * @brief Returns the key of a chunk of a bag.
+     */
+    static uint64_t key(const std::size_t bag, const uint32_t chunk_id)
+    {
+        return (static_cast<uint64_t>(bag) << 32) | chunk_id;
+    }
+
+    /**
+     * @brief Evicts the least recently used chunks until the cached
+     * chunks fit in a size.
+     */
+    void evict(const std::size_t max_bytes);
+
+    std::size_t                                              _max_bytes{0};
+    std::size_t                                              _bytes{0};
+    std::list<Entry>                                         _entries; // Most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> _lookup;
+};
+
+} // namespace rosbag_rviz_panel
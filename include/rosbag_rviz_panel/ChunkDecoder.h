@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BagIndex.h"
+#include "ChunkReader.h"
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief ChunkDecoder.
+ *
+ * Pool of threads that read and decompress chunks ahead of the
+ * messages being read, so the decompression of the upcoming chunks
+ * runs on several cores instead of only on the read-ahead thread.
+ *
+ * The chunks are decoded in the order they are requested, and each
+ * request gets a future of the decoded chunk, so the requester still
+ * reads the messages in time order.
+ *
+ */
+class ChunkDecoder
+{
+  public:
+    /**
+     * @brief Constructor of the ChunkDecoder class.
+     */
+    ChunkDecoder() = default;
+
+    /**
+     * @brief Destructor of the ChunkDecoder class.
+     */
+    ~ChunkDecoder();
+
+    ChunkDecoder(const ChunkDecoder&)            = delete;
+    ChunkDecoder& operator=(const ChunkDecoder&) = delete;
+
+    /**
+     * @brief Starts the decoding threads, stopping the previous ones.
+     *
+     * @param threads std::size_t with the number of threads, 0 to
+     *        stop the pool.
+     */
+    void start(const std::size_t threads);
+
+    /**
+     * @brief Cancels the pending chunks and stops the threads.
+     */
+    void stop(void);
+
+    /**
+     * @brief Returns the number of decoding threads.
+     */
+    std::size_t threads(void) const { return _threads.size(); }
+
+    /**
+     * @brief Queues a chunk to be decoded.
+     *
+     * @param reader ChunkReader with the open rosbag of the chunk. It
+     *        must stay open until the chunk is decoded or cancelled.
+     * @param chunk BagIndex::ChunkInfo with the chunk location.
+     *
+     * @return std::shared_future<ChunkData> with the decoded chunk,
+     *         which rethrows the read errors.
+     */
+    std::shared_future<ChunkData> decode(const ChunkReader& reader, const BagIndex::ChunkInfo& chunk);
+
+    /**
+     * @brief Drops the queued chunks and waits for the chunks being
+     * decoded, after which no reader is used by the pool.
+     */
+    void cancel(void);
+
+  private:
+    /**
+     * @brief Loop of the decoding threads.
+     */
+    void work(void);
+
+    std::vector<std::thread> _threads;
+
+    // Queued chunks, guarded by _mutex
+    std::mutex                                  _mutex;
+    std::condition_variable                     _work_cv;
+    std::condition_variable                     _idle_cv;
+    std::deque<std::packaged_task<ChunkData()>> _queue;
+    std::size_t                                 _running{0};
+    bool                                        _quit{false};
+};
+
+} // namespace rosbag_rviz_panel
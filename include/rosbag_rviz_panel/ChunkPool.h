@@ -0,0 +1,87 @@
+#pragma once
+
+#include <boost/shared_array.hpp>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief ChunkPool.
+ *
+ * Buffers of the decompressed chunks, reused once no chunk, message or
+ * cache entry holds them anymore, so a steady playback reads and
+ * decompresses its chunks without allocating their buffers.
+ *
+ * The pool keeps a reference to every buffer it hands out: a buffer
+ * only referenced by the pool is free. The buffers outlive the pool
+ * while they are held, e.g. by the publishers. Thread-safe.
+ *
+ */
+class ChunkPool
+{
+  public:
+    /**
+     * @brief Constructor of the ChunkPool class.
+     */
+    ChunkPool() = default;
+
+    ChunkPool(const ChunkPool&)            = delete;
+    ChunkPool& operator=(const ChunkPool&) = delete;
+
+    /**
+     * @brief Sets the maximum total size of the free buffers kept for
+     * the next chunks. The buffers in use are not bounded by the pool.
+     *
+     * @param max_bytes std::size_t with the maximum size in bytes.
+     */
+    void setCapacity(const std::size_t max_bytes);
+
+    /**
+     * @brief Returns a buffer of at least the given size, a free one if
+     * any is large enough, or a new one.
+     *
+     * @param size std::size_t with the needed size in bytes.
+     *
+     * @return boost::shared_array<uint8_t> with the buffer, whose
+     *         content is undefined.
+     */
+    boost::shared_array<uint8_t> acquire(const std::size_t size);
+
+    /**
+     * @brief Returns the number of buffers allocated since the pool was
+     * constructed. Can be called from any thread.
+     */
+    uint64_t allocations(void) const;
+
+    /**
+     * @brief Drops the free buffers, the ones in use are left to their
+     * holders.
+     */
+    void clear(void);
+
+  private:
+    /**
+     * @brief Buffer handed out by the pool, free if the pool holds the
+     * only reference.
+     */
+    struct Buffer
+    {
+        boost::shared_array<uint8_t> data;
+        std::size_t                  capacity{0};
+    };
+
+    /**
+     * @brief Drops the largest free buffers until the free buffers fit
+     * in a size. Must be called with the mutex locked.
+     */
+    void trim(const std::size_t max_bytes);
+
+    mutable std::mutex  _mutex;
+    std::vector<Buffer> _buffers;
+    std::size_t         _max_bytes{64 * 1024 * 1024};
+    uint64_t            _allocations{0};
+};
+
+} // namespace rosbag_rviz_panel
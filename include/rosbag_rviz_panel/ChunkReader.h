@@ -0,0 +1,244 @@
+#pragma once
+
+#include <atomic>
+#include <boost/shared_array.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BagIndex.h"
+#include "BagSource.h"
+#include "ChunkPool.h"
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief Serialized data of a message, pointing into the
+ * decompressed chunk that holds it, or into the mapped bag
+ * file, which is kept alive while the MessageData exists.
+ *
+ * The 4 bytes before the data are always its length, as
+ * stored by the message record.
+ */
+struct MessageData
+{
+    boost::shared_array<uint8_t> chunk;
+    const uint8_t*               data{nullptr};
+    uint32_t                     size{0};
+};
+
+/**
+ * @brief Decompressed chunk, shared with the messages that point
+ * into it.
+ */
+struct ChunkData
+{
+    boost::shared_array<uint8_t> data;
+    std::size_t                  size{0};
+    bool                         mapped{false}; // Points into the mapped bag file, without a buffer of its own
+};
+
+/**
+ * @brief Totals of the chunks read from a rosbag, to tell the time
+ * spent reading the file from the time spent decompressing.
+ */
+struct ChunkStatistics
+{
+    uint64_t chunks{0};
+    uint64_t read_bytes{0};    // Bytes read from the file
+    uint64_t read_nsec{0};     // Time spent reading the file
+    uint64_t decoded_bytes{0}; // Bytes of the decompressed chunks
+    uint64_t decode_nsec{0};   // Time spent decompressing, 0 for uncompressed chunks
+    uint64_t allocations{0};   // Chunk buffers allocated instead of reused from a ChunkPool
+
+    /**
+     * @brief Adds the totals of other chunks.
+     */
+    ChunkStatistics& operator+=(const ChunkStatistics& other);
+};
+
+/**
+ * @brief ChunkReader.
+ *
+ * Reads the messages referenced by a BagIndex, decompressing
+ * the chunk that holds them. Only the last read chunk is kept
+ * by the reader, so consecutive messages, forward or backwards,
+ * are served without touching the file again.
+ *
+ * The chunk buffer is shared with the returned messages: it is
+ * reused for the next chunk only if no message still holds it,
+ * otherwise the next chunk gets a buffer from the ChunkPool.
+ *
+ * Chunks can also be decompressed by other threads with readChunk(),
+ * which does not touch the reader state, and then handed to the
+ * reader with setChunk() before reading their messages.
+ *
+ * The chunks are read through a BagSource, so the rosbag can also be
+ * a remote one, read with range requests.
+ *
+ * A local rosbag can be mapped in memory instead: the uncompressed chunks
+ * are then served as spans of the mapping, without any system call or
+ * copy, and the compressed ones are decompressed straight from it.
+ * The mapping lives as long as a chunk or a message points into it.
+ *
+ */
+class ChunkReader
+{
+  public:
+    /**
+     * @brief Constructor of the ChunkReader class.
+     */
+    ChunkReader() = default;
+
+    /**
+     * @brief Destructor of the ChunkReader class.
+     */
+    ~ChunkReader();
+
+    ChunkReader(const ChunkReader&)            = delete;
+    ChunkReader& operator=(const ChunkReader&) = delete;
+
+    /**
+     * @brief Opens a rosbag to read its chunks.
+     *
+     * @param filename std::string with the absolute file path or the
+     *        URL of the rosbag, see BagSource.
+     * @param map Bool set to true to map the rosbag in memory. The
+     *        chunks are read from the file if it can not be mapped,
+     *        and from the source if it is remote.
+     *
+     * @throws rosbag::BagIOException if the file can not be opened.
+     */
+    void open(const std::string& filename, const bool map = false);
+
+    /**
+     * @brief Sets the pool of the chunk buffers, shared with the readers
+     * of the other rosbags. Without a pool, every chunk that can not
+     * reuse the chunk buffer allocates a new one.
+     *
+     * @param pool Pointer to the ChunkPool, which must outlive the
+     *        reader, or nullptr.
+     */
+    void setPool(ChunkPool* pool) { _pool = pool; }
+
+    /**
+     * @brief Closes the rosbag and releases the chunk buffers.
+     */
+    void close(void);
+
+    /**
+     * @brief Returns true if a rosbag is open.
+     */
+    bool isOpen(void) const { return _source != nullptr; }
+
+    /**
+     * @brief Returns true if the open rosbag is mapped in memory.
+     */
+    bool isMapped(void) const { return static_cast<bool>(_mapping); }
+
+    /**
+     * @brief Asks the kernel to read a chunk of the mapped rosbag ahead,
+     * in the background, so it is in memory when it is played. Does
+     * nothing if the rosbag is not mapped. It can be called from any
+     * thread while the rosbag is open.
+     *
+     * @param chunk BagIndex::ChunkInfo with the chunk location.
+     */
+    void advise(const BagIndex::ChunkInfo& chunk) const;
+
+    /**
+     * @brief Reads the serialized data of an indexed message.
+     *
+     * @param index BagIndex of the open rosbag.
+     * @param message std::size_t with the message position in the index.
+     *
+     * @return MessageData pointing into the shared chunk buffer.
+     *
+     * @throws rosbag::BagException if the chunk can not be read or
+     *         decompressed.
+     */
+    MessageData readMessage(const BagIndex& index, const std::size_t message);
+
+    /**
+     * @brief Reads and decompresses a chunk into a new buffer. It can
+     * be called from any thread while the rosbag is open.
+     *
+     * @param chunk BagIndex::ChunkInfo with the chunk location.
+     *
+     * @return ChunkData with the decompressed chunk.
+     *
+     * @throws rosbag::BagException if the chunk can not be read or
+     *         decompressed.
+     */
+    ChunkData readChunk(const BagIndex::ChunkInfo& chunk) const;
+
+    /**
+     * @brief Makes a chunk decompressed by readChunk() the current
+     * chunk, so its messages are read without loading it again.
+     *
+     * @param chunk_id uint32_t with the chunk id in the index.
+     * @param chunk ChunkData with the decompressed chunk.
+     */
+    void setChunk(const uint32_t chunk_id, const ChunkData& chunk);
+
+    /**
+     * @brief Returns true if a chunk is the current chunk.
+     */
+    bool hasChunk(const uint32_t chunk_id) const { return _chunk_loaded && _chunk_id == chunk_id; }
+
+    /**
+     * @brief Returns the totals of the chunks read since the reader was
+     * constructed, by any thread. Can be called from any thread.
+     */
+    ChunkStatistics statistics(void) const;
+
+  private:
+    /**
+     * @brief Reads and decompresses a chunk into the chunk buffer.
+     *
+     * @param chunk BagIndex::ChunkInfo with the chunk location.
+     */
+    void loadChunk(const BagIndex::ChunkInfo& chunk);
+
+    /**
+     * @brief Makes the chunk buffer at least the given size, allocating
+     * a new one if it is too small or still held by a message.
+     *
+     * @param size std::size_t with the needed size in bytes.
+     */
+    void reserveChunk(const std::size_t size);
+
+    /**
+     * @brief Returns a buffer for a chunk, from the pool if there is one.
+     *
+     * @param size std::size_t with the needed size in bytes.
+     */
+    boost::shared_array<uint8_t> allocate(const std::size_t size) const;
+
+    /**
+     * @brief Adds the statistics of a chunk to the totals.
+     */
+    void record(const ChunkStatistics& chunk) const;
+
+    std::unique_ptr<BagSource>   _source;
+    ChunkPool*                   _pool{nullptr};
+    boost::shared_array<uint8_t> _mapping; // Unmapped once no chunk points into it
+    std::size_t                  _mapping_size{0};
+    uint32_t                     _chunk_id{0};
+    bool                         _chunk_loaded{false};
+    boost::shared_array<uint8_t> _chunk;
+    std::size_t                  _chunk_size{0};
+    std::size_t                  _chunk_capacity{0};
+    std::vector<uint8_t>         _compressed;
+
+    // Also updated by the threads calling readChunk()
+    mutable std::atomic<uint64_t> _chunks{0};
+    mutable std::atomic<uint64_t> _read_bytes{0};
+    mutable std::atomic<uint64_t> _read_nsec{0};
+    mutable std::atomic<uint64_t> _decoded_bytes{0};
+    mutable std::atomic<uint64_t> _decode_nsec{0};
+    mutable std::atomic<uint64_t> _allocations{0}; // Without a pool, which counts its own
+};
+
+} // namespace rosbag_rviz_panel
@@ -0,0 +1,375 @@
+#pragma once
+
+#include <ros/time.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BagSet.h"
+#include "ChunkCache.h"
+#include "ChunkDecoder.h"
+#include "ChunkPool.h"
+#include "ChunkReader.h"
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief Serialized message read ahead of the playhead.
+ */
+struct PrefetchedMessage
+{
+    std::size_t bag{0};
+    std::size_t message{0};
+    ros::Time   stamp;
+    uint32_t    connection_id{0}; // Set-wide id, see BagSet
+    MessageData data; // Shares the decompressed chunk, without copying the message
+};
+
+/**
+ * @brief MessagePrefetcher.
+ *
+ * Reads and decompresses the messages of a time range on its own
+ * thread, forward or backwards, into a bounded ring buffer, so the
+ * thread that publishes them only has to wait for their time and
+ * publish, and a slow chunk does not delay the messages already
+ * buffered.
+ *
+ * The messages of every bag of a BagSet are merged into one timeline
+ * by a k-way merge by time stamp over their indexes, and each bag is
+ * read by its own ChunkReader.
+ *
+ * With several decoding threads, the chunks of the next messages in
+ * the merge order are read and decompressed ahead on a ChunkDecoder,
+ * a few chunks at a time, while the messages of the current chunk
+ * are buffered.
+ *
+ * The last decompressed chunks are kept in a ChunkCache across the
+ * runs, so reading again around the playhead, after a seek or in the
+ * other direction, is served from memory.
+ *
+ * The bags can be mapped in memory, the kernel is then asked to read
+ * the next chunks in the playback direction ahead.
+ *
+ * The buffer is bounded both by a number of messages and by the
+ * total size of their data. Buffered messages point into their
+ * decompressed chunks, which stay alive until the messages are
+ * released. The chunk buffers are then reused from a ChunkPool, so
+ * reading a message does not allocate any memory.
+ *
+ */
+class MessagePrefetcher
+{
+  public:
+    /**
+     * @brief Constructor of the MessagePrefetcher class.
+     *
+     * @param bags BagSet with the messages to read. It must outlive
+     *        the prefetcher.
+     */
+    explicit MessagePrefetcher(const BagSet& bags);
+
+    /**
+     * @brief Destructor of the MessagePrefetcher class.
+     */
+    ~MessagePrefetcher();
+
+    MessagePrefetcher(const MessagePrefetcher&)            = delete;
+    MessagePrefetcher& operator=(const MessagePrefetcher&) = delete;
+
+    /**
+     * @brief Opens the rosbags of the set to read the messages from.
+     *
+     * @throws rosbag::BagIOException if a file can not be opened.
+     */
+    void open(void);
+
+    /**
+     * @brief Stops reading and closes the rosbags.
+     */
+    void close(void);
+
+    /**
+     * @brief Sets the limits of the read-ahead buffer. Applied on the
+     * next start().
+     *
+     * @param max_messages std::size_t with the maximum number of
+     *        buffered messages.
+     * @param max_bytes std::size_t with the maximum size of the buffered
+     *        data, which also bounds the free chunk buffers kept for
+     *        reuse. One message is always buffered, whatever its size.
+     */
+    void setCapacity(const std::size_t max_messages, const std::size_t max_bytes);
+
+    /**
+     * @brief Sets the connections whose messages are read. The messages
+     * of the other connections are skipped using the index only, so
+     * their chunks are not read unless they hold a selected message.
+     * Applied on the next start().
+     *
+     * @param connections std::vector<bool> indexed by set-wide
+     *        connection id, true for the connections to read. Empty
+     *        to read them all.
+     */
+    void setConnectionFilter(std::vector<bool> connections);
+
+    /**
+     * @brief Sets the number of threads that decompress the upcoming
+     * chunks. Must not be called while reading.
+     *
+     * @param threads std::size_t with the number of threads, 0 or 1
+     *        to decompress the chunks on the reading thread.
+     */
+    void setDecodeThreads(const std::size_t threads);
+
+    /**
+     * @brief Maps the bags in memory instead of reading their chunks
+     * from the files, see ChunkReader. Applied on the next open().
+     *
+     * @param enable Bool set to true to map the bags.
+     */
+    void setMemoryMapped(const bool enable) { _memory_mapped = enable; }
+
+    /**
+     * @brief Sets the maximum size of the decompressed chunks kept for
+     * the next runs. Must not be called while reading.
+     *
+     * @param max_bytes std::size_t with the maximum size in bytes, 0 to
+     *        keep none.
+     */
+    void setCacheCapacity(const std::size_t max_bytes);
+
+    /**
+     * @brief Starts reading the messages of a time range.
+     *
+     * @param start ros::Time with the first time stamp of the range.
+     * @param end ros::Time with the last time stamp of the range.
+     * @param forward Bool set to true to read the range forward, or
+     *        false to read it backwards, from end to start.
+     */
+    void start(const ros::Time& start, const ros::Time& end, const bool forward);
+
+    /**
+     * @brief Reads one message directly, outside of the read-ahead, such
+     * as the last state of a topic before a seek. Must not be called
+     * while reading.
+     *
+     * @param bag std::size_t with the bag of the message in the set.
+     * @param message std::size_t with the message in the bag index.
+     *
+     * @return MessageData with the serialized message.
+     *
+     * @throws rosbag::BagException if the chunk could not be read.
+     */
+    MessageData readMessage(const std::size_t bag, const std::size_t message);
+
+    /**
+     * @brief Waits for the next message of the range.
+     *
+     * @return Pointer to the message, valid until pop() is called, or
+     *         nullptr if the range is over, the read was interrupted
+     *         or the wait was woken up by wake().
+     */
+    const PrefetchedMessage* front(void);
+
+    /**
+     * @brief Returns true if front() has no more messages to return:
+     * the range is over or the read was interrupted.
+     */
+    bool done(void) const;
+
+    /**
+     * @brief Releases the message returned by front().
+     */
+    void pop(void);
+
+    /**
+     * @brief Makes the current or the next front() return nullptr
+     * without waiting, keeping the read-ahead going. Can be called
+     * from any thread.
+     */
+    void wake(void);
+
+    /**
+     * @brief Interrupts the reading: front() returns nullptr from now
+     * on. Can be called from any thread.
+     */
+    void interrupt(void);
+
+    /**
+     * @brief Interrupts the reading and waits for the reading thread
+     * to finish.
+     */
+    void stop(void);
+
+    /**
+     * @brief Returns the error that stopped the reading, if any.
+     */
+    std::string error(void) const;
+
+    /**
+     * @brief Returns the number of messages in the buffer.
+     */
+    std::size_t depth(void) const { return _depth.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Returns the maximum number of messages in the buffer.
+     */
+    std::size_t capacity(void) const { return _max_messages; }
+
+    /**
+     * @brief Returns the totals of the chunks read from every bag since
+     * the prefetcher was constructed, including the closed ones. Must
+     * be called from the thread that opens and closes the bags.
+     */
+    ChunkStatistics statistics(void) const;
+
+  private:
+    /**
+     * @brief Chunk being decoded ahead, with the number of queued
+     * messages that it holds.
+     */
+    struct PendingChunk
+    {
+        std::size_t                   bag{0};
+        uint32_t                      chunk_id{0};
+        std::shared_future<ChunkData> data;
+        std::size_t                   messages{0};
+    };
+
+    /**
+     * @brief Message waiting for its chunk to be decoded.
+     */
+    struct PendingMessage
+    {
+        std::size_t bag{0};
+        std::size_t message{0};
+    };
+
+    /**
+     * @brief Reading loop, running on the prefetch thread.
+     */
+    void run(const ros::Time start, const ros::Time end, const bool forward);
+
+    /**
+     * @brief Returns true if the messages of a connection are read by
+     * the current run.
+     */
+    bool isSelected(const uint32_t connection_id) const;
+
+    /**
+     * @brief Reads the messages of the range forward, merged by time
+     * stamp, waiting for the bags that are still being indexed.
+     *
+     * @return bool set to false if the reading was interrupted.
+     */
+    bool readForward(const ros::Time& start, const ros::Time& end);
+
+    /**
+     * @brief Reads the messages of the range backwards, merged by time
+     * stamp.
+     *
+     * @return bool set to false if the reading was interrupted.
+     */
+    bool readBackwards(const ros::Time& start, const ros::Time& end);
+
+    /**
+     * @brief Makes the reader of a bag hold one of its chunks, from the
+     * cache if possible, in a new buffer that can be kept. Does nothing
+     * without a cache, the reader then decodes into its own buffer.
+     *
+     * @param bag std::size_t with the bag in the set.
+     * @param chunk_id uint32_t with the chunk in the bag index.
+     */
+    void loadChunk(const std::size_t bag, const uint32_t chunk_id);
+
+    /**
+     * @brief Asks the kernel to read ahead the chunk of a mapped bag
+     * that follows a chunk in the direction of the run.
+     *
+     * @param bag std::size_t with the bag in the set.
+     * @param chunk_id uint32_t with the chunk being read.
+     */
+    void adviseNext(const std::size_t bag, const uint32_t chunk_id);
+
+    /**
+     * @brief Reads a message into the next free slot of the buffer.
+     *
+     * @param bag std::size_t with the bag of the message in the set.
+     * @param message std::size_t with the message in the bag index.
+     *
+     * @return bool set to false if the reading was interrupted.
+     */
+    bool push(const std::size_t bag, const std::size_t message);
+
+    /**
+     * @brief Queues the next message of the merge, submitting its chunk
+     * to the decoder if it is not decoded ahead yet. Pushes the queued
+     * messages while the window of chunks decoded ahead is full.
+     *
+     * @param bag std::size_t with the bag of the message in the set.
+     * @param message std::size_t with the message in the bag index.
+     *
+     * @return bool set to false if the reading was interrupted.
+     */
+    bool enqueue(const std::size_t bag, const std::size_t message);
+
+    /**
+     * @brief Pushes the oldest queued message, waiting for its chunk.
+     *
+     * @return bool set to false if the reading was interrupted.
+     *
+     * @throws rosbag::BagException if the chunk could not be decoded.
+     */
+    bool pushPending(void);
+
+    /**
+     * @brief Pushes every queued message.
+     *
+     * @return bool set to false if the reading was interrupted.
+     */
+    bool flush(void);
+
+    const BagSet&                             _bags;
+    ChunkPool                                 _pool; // Outlives the readers
+    std::vector<std::unique_ptr<ChunkReader>> _readers;
+    std::thread                               _thread;
+    ChunkStatistics                           _closed_statistics; // Of the readers already closed
+    bool                                      _memory_mapped{false};
+    bool                                      _run_forward{true};
+
+    // Chunks decoded ahead and kept, only used by the reading thread
+    ChunkCache                 _cache;
+    ChunkDecoder               _decoder;
+    std::size_t                _decode_ahead{0};
+    std::deque<PendingChunk>   _pending_chunks;
+    std::deque<PendingMessage> _pending_messages;
+
+    std::vector<PrefetchedMessage> _slots;
+    std::size_t                    _max_messages{256};
+    std::size_t                    _max_bytes{64 * 1024 * 1024};
+    std::vector<bool>              _connection_filter, _run_connection_filter;
+
+    // Ring buffer state, guarded by _mutex
+    mutable std::mutex      _mutex;
+    std::condition_variable _not_empty;
+    std::condition_variable _not_full;
+    std::size_t             _head{0};
+    std::size_t             _count{0};
+    std::size_t             _bytes{0};
+    bool                    _finished{false};
+    bool                    _interrupted{false};
+    bool                    _woken{false};
+    std::string             _error;
+
+    std::atomic<std::size_t> _depth{0};
+};
+
+} // namespace rosbag_rviz_panel
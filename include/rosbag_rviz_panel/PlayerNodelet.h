@@ -0,0 +1,68 @@
+#pragma once
+
+#include <nodelet/nodelet.h>
+#include <ros/ros.h>
+#include <std_srvs/SetBool.h>
+
+#include <memory>
+
+#include "BagPlayer.h"
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief PlayerNodelet.
+ *
+ * Runs a BagPlayer inside a nodelet manager, without the panel, so
+ * the nodelets loaded in the same manager receive the messages of
+ * the bags intra-process instead of through a TCPROS loopback socket.
+ *
+ * The bags, given by the bags parameter, are loaded and played when
+ * the nodelet is loaded, with the parameters of the player read from
+ * the private namespace of the nodelet. The playback is paused and
+ * resumed with the pause_playback service, as with rosbag play.
+ *
+ */
+class PlayerNodelet : public nodelet::Nodelet
+{
+  public:
+    /**
+     * @brief Constructor of the PlayerNodelet class.
+     */
+    PlayerNodelet() = default;
+
+    /**
+     * @brief Destructor of the PlayerNodelet class.
+     */
+    ~PlayerNodelet() override;
+
+  private:
+    /**
+     * @brief Loads the bags and starts the playback, unless the autostart
+     * parameter is false.
+     */
+    void onInit(void) override;
+
+    /**
+     * @brief Calls BagPlayer::update() at the update rate of the player,
+     * on the callback queue of the nodelet, like the commands.
+     */
+    void update(const ros::WallTimerEvent& event);
+
+    /**
+     * @brief Service callback to pause or resume the playback.
+     *
+     * @param req std_srvs::SetBool::Request with data set to true to
+     *        pause, or false to resume.
+     * @param res std_srvs::SetBool::Response, always successful.
+     *
+     * @return bool set to true.
+     */
+    bool pausePlayback(std_srvs::SetBool::Request& req, std_srvs::SetBool::Response& res);
+
+    std::unique_ptr<BagPlayer> _player;
+    ros::WallTimer             _update_timer;
+    ros::ServiceServer         _pause_service;
+};
+
+} // namespace rosbag_rviz_panel
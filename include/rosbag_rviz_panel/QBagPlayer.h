@@ -1,24 +1,29 @@
 #pragma once
 
-#include <ros/ros.h>
-#include <rosbag/bag.h>
-#include <rosbag/view.h>
+#include <rosbag/macros.h>
 
+#include <QMetaType>
 #include <QObject>
 #include <QString>
-#include <mutex>
-#include <thread>
+#include <QStringList>
+#include <QTimer>
+#include <string>
+#include <vector>
+
+#include "BagPlayer.h"
 
 namespace rosbag_rviz_panel {
 
 /**
  * @brief QBagPlayer.
  *
- * This custom QOBject opens a rosbag and plays it, forward or
- * backwards, at different speed rates.
+ * This custom QOBject is the Qt adapter of a BagPlayer: its slots
+ * run the commands of the player, its signals forward the state
+ * changes of the player, and a timer calls BagPlayer::update() at
+ * the user interface update rate, on the thread of the QBagPlayer.
  *
  */
-class ROSBAG_STORAGE_DECL QBagPlayer : public QObject
+class ROSBAG_STORAGE_DECL QBagPlayer : public QObject, private BagPlayer::Listener
 {
     Q_OBJECT
 
@@ -35,156 +40,133 @@ class ROSBAG_STORAGE_DECL QBagPlayer : public QObject
      */
     virtual ~QBagPlayer();
 
-  private:
-    /**
-     * @brief Main loop to play rosbags, forward or backwards.
-     */
-    void run(void);
-
-    /**
-     * @brief Create a ros::AdvertiseOptions object to create
-     * a publisher for the given topic.
-     *
-     * @param c rosbag::ConnectionInfo to check if the topic is
-     *          latching its messages.
-     * @param queue_size uint32_t with the size of the queue for
-     *        the ros publisher.
-     * @param prefix std::string with an optional prefix for the
-     *        topic to publish to.
-     *
-     * @return ros::AdvertiseOptions with all the given info.
-     */
-    ros::AdvertiseOptions createAdvertiseOptions(
-            const rosbag::ConnectionInfo* c,
-            uint32_t                      queue_size,
-            const std::string&            prefix);
-
     /**
-     * @brief Checks if latch was true or false for a topic.
-     *
-     * @param c rosbag::ConnectionInfo to check if the topic is
-     *          latching its messages.
-     *
-     * @return bool with the value of the latching option.
+     * @brief Returns the options of the publishers, see
+     * BagPlayer::publisherOptions(). Must be called before the player
+     * is moved to its thread.
      */
-    bool isLatching(const rosbag::ConnectionInfo* c);
+    const PublisherOptions& publisherOptions(void) const { return _player.publisherOptions(); }
 
     /**
-     * @brief Converts the size of a rosbag into
-     * {"B", "KB", "MB", "GB", "TB", "PB", "EB", "ZB", "YB"}.
-     *
-     * @param size uint64_t with the size of the rosbag.
-     *
+     * @brief Returns the maximum size in MB of the chunk cache, see
+     * BagPlayer::chunkCacheSize(). Must be called before the player is
+     * moved to its thread.
      */
-    void sizeToStr(const uint64_t size);
+    double chunkCacheSize(void) const { return _player.chunkCacheSize(); }
 
+  private:
     /**
-     * @brief Resets some variables to restart bag replay.
+     * @brief BagPlayer::Listener methods, which emit the matching
+     * Q_SIGNAL from the thread of the player that calls them.
      */
-    void reset(void);
+    void onBagFinished(void) override;
+    void onBagSize(const std::string& size) override;
+    void onPlaybackSpeed(const double speed, const bool unthrottled) override;
+    void onStatusText(const std::string& status) override;
+    void onEnableActionButtons(const bool enable) override;
+    void onLoadProgress(const int progress) override;
+    void onEnableSeekControls(const bool enable) override;
+    void onPlayheadState(const PlayheadState& state) override;
+    void onTopics(const std::vector<std::string>& topics) override;
+    void onExportProgress(const int progress) override;
+    void onTimelineDensity(const TimelineDensity& density) override;
 
+  Q_SIGNALS:
     /**
-     * @brief Resets all UI text labels.
+     * @brief Q_SIGNAL to notify that the bag is completed.
      */
-    void resetTxt(void);
+    void sendBagFinished(void);
 
     /**
-     * @brief Calculate the time stamp to send ROS to sleep
-     * until that stamp has been reached.
-     *
-     * @param msg_time ros::Time with the last proccessed
-     *        message time stamp.
+     * @brief Q_SIGNAL that sends the total size of the bag.
      *
-     * @return ros::Time with the time stam to sleep until.
+     * @param size QString that contains the total bag size.
      */
-    ros::Time real_time(const ros::Time& msg_time);
+    void sendBagSize(const QString size);
 
     /**
-     * @brief Calculate the time stamp to start playing from
-     * the clicked progress bar value.
-     *
-     * @param progress Int value of the progress bar [0, 100]
+     * @brief Q_SIGNAL that sends the playback speed and mode.
      *
-     * @return ros::Time with the calculated time stamp.
-     */
-    ros::Time getProgressTime(const int progress);
-
-  Q_SIGNALS:
-    /**
-     * @brief Q_SIGNAL to notify that the bag is completed.
+     * @param speed Double with the actual playback speed, or 0 to clear it.
+     * @param unthrottled Bool set to true if the messages are played as
+     *        fast as possible.
      */
-    void sendBagFinished(void);
+    void sendPlaybackSpeed(const double speed, const bool unthrottled);
 
     /**
-     * @brief Q_SIGNAL that sends the total size of the bag.
+     * @brief Q_SIGNAL that sends a text to notify the user about something.
      *
-     * @param size QString that contains the total bag size.
+     * @param status QString that contains the status message to be shown.
      */
-    void sendBagSize(const QString size);
+    void sendStatusText(const QString status);
 
     /**
-     * @brief Q_SIGNAL that sends the actual stamp time.
+     * @brief Q_SIGNAL that enables or disables the action buttons from the
+     *        parent QWidget.
      *
-     * @param stamp_label QString that contains the time stamp.
+     * @param enable Bool to enable or disable all action buttons.
      */
-    void sendStampLabel(const QString stamp_label);
+    void sendEnableActionButtons(const bool enable);
 
     /**
-     * @brief Q_SIGNAL that sends the actual stamp in a human-readable
-     *        date, in a QString.
+     * @brief Q_SIGNAL that sends the loading progress of the bag.
      *
-     * @param human_date QString that contains the time stamp in a
-     *        human-redable format.
+     * @param progress Int value [0, 100] with the indexed percentage.
      */
-    void sendDateLabel(const QString human_date);
+    void sendLoadProgress(const int progress);
 
     /**
-     * @brief Q_SIGNAL that sends the playback speed.
+     * @brief Q_SIGNAL that enables or disables the controls that need
+     *        the whole bag to be indexed: seeking and reverse playback.
      *
-     * @param speed QString that contains the actual playback speed.
+     * @param enable Bool to enable or disable the seek controls.
      */
-    void sendPlayspeedLabel(const QString speed);
+    void sendEnableSeekControls(const bool enable);
 
     /**
-     * @brief Q_SIGNAL that sends the number of seconds the current playhead
-     *        location is from the beginning of the bag.
+     * @brief Q_SIGNAL that sends the current playhead location. It is
+     *        sent at most at the user interface update rate.
      *
-     * @param seconds QString that contains the current playhead location
-     *        in seconds.
+     * @param state PlayheadState with the playhead and bag time stamps.
      */
-    void sendSecondsLabel(const QString seconds);
+    void sendPlayheadState(const PlayheadState state);
 
     /**
-     * @brief Q_SIGNAL that sends a text to notify the user about something.
+     * @brief Q_SIGNAL that sends the topics of the loaded bag, which
+     *        are all selected on load.
      *
-     * @param status QString that contains the status message to be shown.
+     * @param topics QStringList with the sorted topic names.
      */
-    void sendStatusText(const QString status);
+    void sendTopics(const QStringList topics);
 
     /**
-     * @brief Q_SIGNAL that enables or disables the action buttons from the
-     *        parent QWidget.
+     * @brief Q_SIGNAL that sends the progress of an export, from the
+     *        export thread.
      *
-     * @param enable Bool to enable or disable all action buttons.
+     * @param progress Int value [0, 100] with the exported percentage,
+     *        100 once the export is over.
      */
-    void sendEnableActionButtons(const bool enable);
+    void sendExportProgress(const int progress);
 
     /**
-     * @brief Q_SIGNAL that sends a value [0, 100] to set the progress bar.
+     * @brief Q_SIGNAL that sends the density of the selected topics over
+     *        the timeline, once the bags are indexed and when the
+     *        selection changes.
      *
-     * @param progress Int value with the calculated progress.
+     * @param density TimelineDensity with the density, empty to clear it.
      */
-    void sendPlayheadProgress(const int progress);
+    void sendTimelineDensity(const TimelineDensity density);
 
   public Q_SLOTS:
     /**
-     * @brief Q_SLOT to receive the absolute file path of the selected
-     *        rosbag to be loaded.
+     * @brief Q_SLOT to receive the absolute file paths of the selected
+     *        rosbags to be loaded. They are played as one timeline,
+     *        merged by time stamp.
      *
-     * @param filename QString that contains the absolute file path of
-     *        the rosbag.
+     * @param filenames QStringList that contains the absolute file
+     *        paths of the rosbags.
      */
-    void receiveLoadBag(const QString filename);
+    void receiveLoadBags(const QStringList filenames);
 
     /**
      * @brief Q_SLOT to set the time stamp for the beginning of
@@ -210,6 +192,23 @@ class ROSBAG_STORAGE_DECL QBagPlayer : public QObject
      */
     void receiveChangeSpeed(const float change);
 
+    /**
+     * @brief Q_SLOT to set the playback speed.
+     *
+     * @param speed Double with the new playback speed, negative to
+     *        play backwards. Zero is ignored.
+     */
+    void receiveSetSpeed(const double speed);
+
+    /**
+     * @brief Q_SLOT to enable or disable the playback as fast as
+     *        possible, publishing every message as soon as it is read
+     *        instead of at its time stamp.
+     *
+     * @param enable Bool set to true to play unthrottled.
+     */
+    void receiveSetUnthrottled(const bool enable);
+
     /**
      * @brief Q_SLOT to pause the bag reproduction, if it is being
      *        played during the signal reception.
@@ -238,34 +237,104 @@ class ROSBAG_STORAGE_DECL QBagPlayer : public QObject
      * @brief Q_SLOT to set the new start ros time samp from the
      * clicked progress bar value
      *
-     * @param value Int with the value [0, 100] from the
+     * @param value Double with the value [0, 1] from the
      *        progress bar.
      */
-    void receiveClickedProgress(int value);
+    void receiveClickedProgress(double value);
+
+    /**
+     * @brief Q_SLOT to select the topics to play. The messages of the
+     *        other topics are neither read nor published.
+     *
+     * @param topics QStringList with the names of the selected topics.
+     */
+    void receiveSelectTopics(const QStringList topics);
+
+    /**
+     * @brief Q_SLOT to show the density of a single topic.
+     *
+     * @param topic QString with the name of the topic, empty for all
+     *        the selected topics.
+     */
+    void receiveSetDensityTopic(const QString topic);
+
+    /**
+     * @brief Q_SLOT to step through the messages of a topic, pausing
+     *        the playback. Stepping forward publishes every selected
+     *        message up to the message stepped to, stepping backwards
+     *        publishes the messages at its time stamp.
+     *
+     * @param topic QString with the topic to step through.
+     * @param count Int with the number of messages of the topic to
+     *        step, negative to step backwards.
+     */
+    void receiveStep(const QString topic, const int count);
+
+    /**
+     * @brief Q_SLOT to set the start of the A/B range at the playhead,
+     *        or to move it back to the beginning of the bag.
+     *
+     * @param enable Bool set to true to set the start at the playhead.
+     */
+    void receiveSetRangeStart(const bool enable);
+
+    /**
+     * @brief Q_SLOT to set the end of the A/B range at the playhead,
+     *        or to move it back to the end of the bag.
+     *
+     * @param enable Bool set to true to set the end at the playhead.
+     */
+    void receiveSetRangeEnd(const bool enable);
+
+    /**
+     * @brief Q_SLOT to play the A/B range in a loop, reading it again
+     *        from the indexes and the chunk cache on every pass.
+     *
+     * @param enable Bool set to true to loop.
+     */
+    void receiveSetLoop(const bool enable);
+
+    /**
+     * @brief Q_SLOT to set the queue sizes and the topic prefix of the
+     *        publishers, advertising the selected topics again.
+     *
+     * @param options PublisherOptions with the new options.
+     */
+    void receiveSetPublisherOptions(const PublisherOptions options);
+
+    /**
+     * @brief Q_SLOT to set the A/B range, clamped to the bags.
+     *
+     * @param start ros::Time with the first time stamp of the range.
+     * @param end ros::Time with the last time stamp of the range.
+     */
+    void receiveSetRange(const ros::Time start, const ros::Time end);
+
+    /**
+     * @brief Q_SLOT to set the maximum size of the chunk cache.
+     *
+     * @param megabytes Double with the size in MB, 0 to keep none.
+     */
+    void receiveSetChunkCacheSize(const double megabytes);
+
+    /**
+     * @brief Q_SLOT to export the messages of the selected topics in the
+     *        A/B range into a new rosbag, on a background thread.
+     *
+     * @param filename QString with the absolute path of the new rosbag.
+     */
+    void receiveExportRange(const QString filename);
 
   private:
-    ros::NodeHandle               _nh;
-    rosbag::Bag                   _bag;
-    std::unique_ptr<rosbag::View> _full_view;
-
-    std::map<std::string, ros::Publisher> _pubs;
-    std::vector<rosbag::View::iterator>   _reverse_bag;
-    std::thread                           _play_thread;
-
-    ros::Time _bag_control_start;
-    ros::Time _bag_control_end;
-    ros::Time _full_bag_start, _full_bag_end;
-    ros::Time _last_message_time;
-    ros::Time _play_start;
-
-    double _playback_speed{1.0};
-    bool   _pause{false};
-    bool   _thread_running{false};
-    bool   _playback_direction_changed{false};
-
-    std::mutex _playback_mutex;
-    std::mutex _pause_mutex;
-    std::mutex _thread_mutex;
+    BagPlayer _player;
+
+    // Child of the player, so it is moved to the player thread with it
+    QTimer* _telemetry_timer;
 };
 
-} // namespace rosbag_rviz_panel
\ No newline at end of file
+} // namespace rosbag_rviz_panel
+
+Q_DECLARE_METATYPE(ros::Time)
+Q_DECLARE_METATYPE(rosbag_rviz_panel::PlayheadState)
+Q_DECLARE_METATYPE(rosbag_rviz_panel::PublisherOptions)
+Q_DECLARE_METATYPE(rosbag_rviz_panel::TimelineDensity)
@@ -1,8 +1,15 @@
 #pragma once
 
+#include <QContextMenuEvent>
+#include <QImage>
 #include <QMouseEvent>
+#include <QPaintEvent>
 #include <QProgressBar>
+#include <QResizeEvent>
+#include <QStringList>
 #include <QWidget>
+#include <cstdint>
+#include <vector>
 
 namespace rosbag_rviz_panel {
 
@@ -11,7 +18,11 @@ namespace rosbag_rviz_panel {
  *
  * This custom QWidget inherits from a regular QProgressBar,
  * with additional functionalities such as changing its value
- * when the bar is clicked.
+ * when the bar is clicked, showing the A/B range and a heat strip
+ * with the density of the messages over the timeline.
+ *
+ * Its resolution is finer than a percentage, so a click seeks to
+ * the clicked pixel even on a long bag.
  *
  */
 class QCustomProgressBar : public QProgressBar
@@ -19,6 +30,11 @@ class QCustomProgressBar : public QProgressBar
     Q_OBJECT
 
   public:
+    /**
+     * @brief Maximum value of the bar, its values are fractions of it.
+     */
+    static constexpr int RESOLUTION = 100000;
+
     /**
      * @brief Constructor of the QCustomProgressBar class.
      *
@@ -31,12 +47,60 @@ class QCustomProgressBar : public QProgressBar
      */
     virtual ~QCustomProgressBar();
 
+    /**
+     * @brief Sets the A/B range shown over the bar.
+     *
+     * @param start Double [0, 1] with the start of the range as a
+     *        fraction of the bar, negative to hide it.
+     * @param end Double [0, 1] with the end of the range as a fraction
+     *        of the bar, negative to hide it.
+     */
+    void setMarkers(const double start, const double end);
+
+    /**
+     * @brief Sets the value of the bar.
+     *
+     * @param progress Double [0, 1] with the value as a fraction of
+     *        the bar.
+     */
+    void setProgress(const double progress);
+
+    /**
+     * @brief Sets the density shown in the heat strip, downsampled to
+     * the width of the bar when it is drawn.
+     *
+     * @param messages std::vector<uint32_t> with the messages by bin,
+     *        the bins cover the bar evenly. Empty to hide the strip.
+     * @param bytes std::vector<uint64_t> with the bytes by bin, with
+     *        as many bins as the messages.
+     */
+    void setDensity(const std::vector<uint32_t>& messages, const std::vector<uint64_t>& bytes);
+
+    /**
+     * @brief Sets the topics the heat strip can be restricted to, from
+     * its context menu. The strip goes back to all the selected topics.
+     *
+     * @param topics QStringList with the topics of the bags.
+     */
+    void setDensityTopics(const QStringList& topics);
+
   Q_SIGNALS:
     /**
      * @brief Q_SIGNAL to notify that the progress bar
      * has been clicked, in order to update the bag time stamp.
+     *
+     * @param val Double [0, 1] with the clicked value as a fraction of
+     *        the bar.
+     */
+    void sendClickedProgress(double val);
+
+    /**
+     * @brief Q_SIGNAL to restrict the heat strip to a single topic.
+     *
+     * @param topic QString with the name of the topic, empty for all
+     *        the selected topics.
      */
-    void sendClickedProgress(int val);
+    void sendDensityTopic(const QString topic);
 
   protected:
     /**
@@ -44,5 +108,42 @@ class QCustomProgressBar : public QProgressBar
      * mouse interaction logic.
      */
     void mousePressEvent(QMouseEvent* event) override;
+
+    /**
+     * @brief Overrided method from the parent class to draw the A/B
+     * range over the bar.
+     */
+    void paintEvent(QPaintEvent* event) override;
+
+    /**
+     * @brief Overrided method from the parent class to downsample the
+     * heat strip again at the new width.
+     */
+    void resizeEvent(QResizeEvent* event) override;
+
+    /**
+     * @brief Overrided method from the parent class to choose whether
+     * the heat strip shows the messages or the bytes, and of which
+     * topics.
+     */
+    void contextMenuEvent(QContextMenuEvent* event) override;
+
+  private:
+    /**
+     * @brief Downsamples the density into one pixel per column of the
+     * bar, on a logarithmic scale so sparse topics stay visible.
+     */
+    void updateStrip(void);
+
+    double _marker_start{-1.0};
+    double _marker_end{-1.0};
+
+    // Full resolution density, the strip is rebuilt from it when it is null
+    std::vector<double> _density_messages;
+    std::vector<double> _density_bytes;
+    bool                _show_bytes{false};
+    QStringList         _density_topics;
+    QString             _density_topic; // Empty for all the selected topics
+    QImage              _strip;
 };
 } // namespace rosbag_rviz_panel
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QDialog>
+#include <QLineEdit>
+#include <QSpinBox>
+#include <QStringList>
+#include <QTableWidget>
+#include <QWidget>
+
+#include "BagPlayer.h"
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief QPublisherOptionsDialog.
+ *
+ * This custom QDialog edits the PublisherOptions of the player: the
+ * prefix of the published topics, the default queue size and the
+ * queue size of every topic of the loaded bags.
+ *
+ */
+class QPublisherOptionsDialog : public QDialog
+{
+    Q_OBJECT
+
+  public:
+    /**
+     * @brief Constructor of the QPublisherOptionsDialog class.
+     *
+     * @param topics QStringList with the topics of the loaded bags.
+     * @param options PublisherOptions with the current options.
+     * @param parent A parent QWidget, if there is one.
+     */
+    QPublisherOptionsDialog(const QStringList& topics, const PublisherOptions& options, QWidget* parent = nullptr);
+
+    /**
+     * @brief Destructor of the QPublisherOptionsDialog class.
+     */
+    virtual ~QPublisherOptionsDialog();
+
+    /**
+     * @brief Returns the edited options. The queue sizes of the topics
+     * that are not in the loaded bags are kept as they were.
+     */
+    PublisherOptions options(void) const;
+
+  private:
+    PublisherOptions _options;
+    QStringList      _topics;
+    QLineEdit*       _prefix_edit;
+    QSpinBox*        _queue_size_spinbox;
+    QTableWidget*    _topics_table;
+};
+} // namespace rosbag_rviz_panel
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <ros/message_traits.h>
+#include <ros/serialization.h>
+#include <rosbag/structures.h>
+
+#include <cstring>
+
+#include "ChunkReader.h"
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief RawMessage.
+ *
+ * Serialized message of a bag connection, published as it is
+ * stored in the bag: its serialization shares the decompressed
+ * chunk that holds it, so the transport sends the bytes read
+ * from the bag without deserializing or copying them. It can
+ * also be written into another bag with rosbag::Bag::write().
+ *
+ */
+struct RawMessage
+{
+    const rosbag::ConnectionInfo* connection{nullptr};
+    MessageData                   data;
+};
+
+} // namespace rosbag_rviz_panel
+
+namespace ros {
+namespace message_traits {
+
+template <>
+struct MD5Sum<rosbag_rviz_panel::RawMessage>
+{
+    static const char* value(const rosbag_rviz_panel::RawMessage& m) { return m.connection->md5sum.c_str(); }
+    static const char* value() { return "*"; }
+};
+
+template <>
+struct DataType<rosbag_rviz_panel::RawMessage>
+{
+    static const char* value(const rosbag_rviz_panel::RawMessage& m) { return m.connection->datatype.c_str(); }
+    static const char* value() { return "*"; }
+};
+
+template <>
+struct Definition<rosbag_rviz_panel::RawMessage>
+{
+    static const char* value(const rosbag_rviz_panel::RawMessage& m) { return m.connection->msg_def.c_str(); }
+};
+
+} // namespace message_traits
+
+namespace serialization {
+
+/**
+ * @brief Serializes a RawMessage by pointing to its data: the 4 bytes
+ * stored before the data of a bag message record are its length, which
+ * is the length prefix of the serialized message.
+ */
+template <>
+inline SerializedMessage serializeMessage<rosbag_rviz_panel::RawMessage>(const rosbag_rviz_panel::RawMessage& message)
+{
+    SerializedMessage m;
+    m.buf           = boost::shared_array<uint8_t>(message.data.chunk, const_cast<uint8_t*>(message.data.data) - 4);
+    m.num_bytes     = message.data.size + 4;
+    m.message_start = m.buf.get() + 4;
+    return m;
+}
+
+/**
+ * @brief Writes the data of a RawMessage as it is stored, e.g. by
+ * rosbag::Bag::write(). A RawMessage can not be read.
+ */
+template <>
+struct Serializer<rosbag_rviz_panel::RawMessage>
+{
+    template <typename Stream>
+    inline static void write(Stream& stream, const rosbag_rviz_panel::RawMessage& message)
+    {
+        std::memcpy(stream.advance(message.data.size), message.data.data, message.data.size);
+    }
+
+    inline static uint32_t serializedLength(const rosbag_rviz_panel::RawMessage& message) { return message.data.size; }
+};
+
+} // namespace serialization
+} // namespace ros
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+
+namespace rosbag_rviz_panel {
+
+/**
+ * @brief SeqLock.
+ *
+ * Value shared between threads, read without locking: a reader
+ * copies it and copies it again if a writer changed it meanwhile.
+ * Writers are serialized by a mutex, and are never blocked by the
+ * readers, so a thread that reads the value for every message does
+ * not contend with the threads that seldom change it.
+ *
+ * The value is stored in atomic words, so it must be trivially
+ * copyable.
+ *
+ */
+template <typename T>
+class SeqLock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock values must be trivially copyable");
+
+  public:
+    /**
+     * @brief Constructor of the SeqLock class.
+     *
+     * @param value T with the initial value.
+     */
+    explicit SeqLock(const T& value = T()) { write(value); }
+
+    SeqLock(const SeqLock&)            = delete;
+    SeqLock& operator=(const SeqLock&) = delete;
+
+    /**
+     * @brief Returns a consistent copy of the value, without locking.
+     */
+    T load(void) const
+    {
+        std::array<uint64_t, WORDS> words;
+        for (;;) {
+            const auto seq = _seq.load(std::memory_order_acquire);
+            if (seq & 1)
+                continue;
+
+            for (std::size_t i = 0; i < WORDS; ++i)
+                words[i] = _words[i].load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_seq.load(std::memory_order_relaxed) == seq)
+                break;
+        }
+
+        T value;
+        std::memcpy(static_cast<void*>(&value), words.data(), sizeof(T));
+        return value;
+    }
+
+    /**
+     * @brief Replaces the value.
+     *
+     * @param value T with the new value.
+     */
+    void store(const T& value)
+    {
+        std::lock_guard<std::mutex> lock(_write_mutex);
+        write(value);
+    }
+
+    /**
+     * @brief Modifies the value in place, atomically with respect to
+     * the other writers.
+     *
+     * @param modify Callable taking a T& with the value to modify.
+     */
+    template <typename F>
+    void update(F&& modify)
+    {
+        std::lock_guard<std::mutex> lock(_write_mutex);
+        T                           value = load();
+        modify(value);
+        write(value);
+    }
+
+  private:
+    static constexpr std::size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    /**
+     * @brief Publishes a new value. Called by one writer at a time.
+     */
+    void write(const T& value)
+    {
+        std::array<uint64_t, WORDS> words{};
+        std::memcpy(words.data(), &value, sizeof(T));
+
+        const auto seq = _seq.load(std::memory_order_relaxed);
+        _seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (std::size_t i = 0; i < WORDS; ++i)
+            _words[i].store(words[i], std::memory_order_relaxed);
+
+        _seq.store(seq + 2, std::memory_order_release);
+    }
+
+    std::atomic<uint64_t>                    _seq{0};
+    std::array<std::atomic<uint64_t>, WORDS> _words{};
+    std::mutex                               _write_mutex;
+};
+
+} // namespace rosbag_rviz_panel
@@ -1,10 +1,19 @@
 #include "rosbag_rviz_panel/BagPlayerWidget.h"
 
+#include <QComboBox>
+#include <QDateTime>
+#include <QDoubleSpinBox>
 #include <QFileDialog>
 #include <QIcon>
+#include <QInputDialog>
+#include <QLineEdit>
 #include <QMessageBox>
 #include <QPushButton>
+#include <QSignalBlocker>
+#include <QSpinBox>
 
+#include "rosbag_rviz_panel/BagSource.h"
+#include "rosbag_rviz_panel/QPublisherOptionsDialog.h"
 #include "ui_BagPlayerWidget.h"
 
 #define INCREASE_PLAYBACK_SPEED 0.5
@@ -19,12 +28,18 @@ BagPlayerWidget::BagPlayerWidget(QWidget* parent) : QWidget(parent), _ui(std::ma
     setObjectName("QBagPlayer");
 
     _progress_bar = std::make_unique<QCustomProgressBar>(this);
-    _progress_bar->setRange(0, 100);
     _progress_bar->setEnabled(false);
     _ui->horizontalLayout_2->addWidget(_progress_bar.get());
 
+    _topics_menu = std::make_unique<QMenu>(this);
+    _ui->topics_button->setMenu(_topics_menu.get());
+
     _player_thread = std::make_unique<QThread>(this);
     _player        = std::make_unique<QBagPlayer>();
+
+    // Read from the parameters of the player, before it runs on its thread
+    _publisher_options = _player->publisherOptions();
+    _chunk_cache_mb    = _player->chunkCacheSize();
     _player->moveToThread(_player_thread.get());
     connect(_player_thread.get(), &QThread::finished, _player.get(), &QBagPlayer::deleteLater, Qt::QueuedConnection);
     _player_thread->start();
@@ -38,11 +53,27 @@ BagPlayerWidget::BagPlayerWidget(QWidget* parent) : QWidget(parent), _ui(std::ma
     _ui->slower_button->setIcon(QIcon::fromTheme("media-seek-backward"));
     _ui->faster_button->setIcon(QIcon::fromTheme("media-seek-forward"));
     _ui->load_button->setIcon(QIcon::fromTheme("document-open"));
+    _ui->url_button->setIcon(QIcon::fromTheme("network-server"));
+    _ui->step_back_button->setIcon(QIcon::fromTheme("go-previous"));
+    _ui->step_forward_button->setIcon(QIcon::fromTheme("go-next"));
 
     connect(_ui->play_button, &QPushButton::clicked, this, &BagPlayerWidget::handlePlayClicked);
     connect(_ui->slower_button, &QPushButton::clicked, this, &BagPlayerWidget::handleSlowerClicked);
     connect(_ui->faster_button, &QPushButton::clicked, this, &BagPlayerWidget::handleFasterClicked);
     connect(_ui->load_button, &QPushButton::clicked, this, &BagPlayerWidget::handleLoadClicked);
+    connect(_ui->url_button, &QPushButton::clicked, this, &BagPlayerWidget::handleUrlClicked);
+    connect(_ui->step_back_button, &QPushButton::clicked, this, [this]() { handleStepClicked(false); });
+    connect(_ui->step_forward_button, &QPushButton::clicked, this, [this]() { handleStepClicked(true); });
+    connect(_ui->max_speed_button, &QPushButton::toggled, this, &BagPlayerWidget::sendSetUnthrottled);
+    connect(_ui->range_start_button, &QPushButton::toggled, this, &BagPlayerWidget::sendSetRangeStart);
+    connect(_ui->range_end_button, &QPushButton::toggled, this, &BagPlayerWidget::sendSetRangeEnd);
+    connect(_ui->loop_button, &QPushButton::toggled, this, &BagPlayerWidget::sendSetLoop);
+    connect(_ui->publishers_button, &QPushButton::clicked, this, &BagPlayerWidget::handlePublishersClicked);
+    connect(_ui->export_button, &QPushButton::clicked, this, &BagPlayerWidget::handleExportClicked);
+    connect(_ui->playspeed_spinbox,
+            QOverload<double>::of(&QDoubleSpinBox::valueChanged),
+            this,
+            &BagPlayerWidget::sendSetSpeed);
 
     receiveEnableActionButtons(false);
 }
@@ -85,27 +116,294 @@ void BagPlayerWidget::handleSlowerClicked(void)
 
 void BagPlayerWidget::handleLoadClicked(void)
 {
-    const QFileInfo filename = QFileDialog::getOpenFileName(
+    // Several bags of a split recording can be selected, they are played as one timeline
+    const QStringList selected = QFileDialog::getOpenFileNames(
             this,
-            tr("Select the bag to load"),
+            tr("Select the bags to load"),
             QDir::homePath(),
             tr("Bag file (*.bag)"),
             nullptr,
             QFileDialog::DontUseNativeDialog);
 
-    if (filename.exists() && !filename.absoluteFilePath().isEmpty()) {
-        try {
-            Q_EMIT sendLoadBag(filename.absoluteFilePath());
-        } catch (const rosbag::BagException& e) {
-            ROS_ERROR_STREAM(e.what());
+    QStringList filenames;
+    for (const auto& file : selected) {
+        const QFileInfo filename(file);
+        if (!filename.exists() || filename.absoluteFilePath().isEmpty()) {
+            std::string msg = "File: '" + filename.absoluteFilePath().toStdString() + "' does not exist!";
+            ROS_WARN_STREAM(msg);
+            return;
+        }
+        filenames.append(filename.absoluteFilePath());
+    }
+
+    if (filenames.isEmpty())
+        return;
+
+    loadBags(filenames);
+}
 
-            receiveStatusText(QString::fromStdString(e.what()));
-            receiveEnableActionButtons(false);
+void BagPlayerWidget::handleUrlClicked(void)
+{
+    // The remote bags of the last load are proposed again
+    QStringList last;
+    for (const auto& bag : _bags) {
+        if (BagSource::isRemote(bag.toStdString()))
+            last.append(bag);
+    }
+
+    bool       ok   = false;
+    const auto text = QInputDialog::getText(
+            this,
+            tr("Load remote bags"),
+            tr("http:// or https:// URLs of the bags, separated by spaces:"),
+            QLineEdit::Normal,
+            last.join(' '),
+            &ok);
+    if (!ok || text.trimmed().isEmpty())
+        return;
+
+    const QStringList urls = text.simplified().split(' ');
+    for (const auto& url : urls) {
+        if (!BagSource::isRemote(url.toStdString())) {
+            receiveStatusText("Not an http:// or https:// URL: " + url);
+            return;
         }
-    } else {
-        std::string msg = "File: '" + filename.absoluteFilePath().toStdString() + "' does not exist!";
-        ROS_WARN_STREAM(msg);
     }
+
+    loadBags(urls);
+}
+
+void BagPlayerWidget::loadBags(const QStringList& filenames)
+{
+    // A manual load replaces the session being restored
+    _session_pending = false;
+    _bags            = filenames;
+
+    try {
+        Q_EMIT sendLoadBags(filenames);
+    } catch (const rosbag::BagException& e) {
+        ROS_ERROR_STREAM(e.what());
+
+        receiveStatusText(QString::fromStdString(e.what()));
+        receiveEnableActionButtons(false);
+    }
+}
+
+void BagPlayerWidget::handleStepClicked(const bool forward)
+{
+    const auto topic = _ui->step_topic_combo->currentText();
+    if (topic.isEmpty())
+        return;
+
+    // Stepping pauses the playback
+    if (_ui->play_button->isChecked())
+        _ui->play_button->click();
+
+    const int count = _ui->step_count_spinbox->value();
+    Q_EMIT sendStep(topic, forward ? count : -count);
+}
+
+void BagPlayerWidget::handleTopicsChanged(void)
+{
+    QStringList topics;
+    for (const auto* action : _topic_actions) {
+        if (action->isChecked())
+            topics.append(action->data().toString());
+    }
+
+    _ui->topics_button->setText(QString("Topics (%1/%2)").arg(topics.size()).arg(_topic_actions.size()));
+    Q_EMIT sendSelectTopics(topics);
+}
+
+void BagPlayerWidget::handleSelectAllTopics(const bool checked)
+{
+    // Sent once for all the topics, not once per topic
+    for (auto* action : _topic_actions) {
+        const QSignalBlocker blocker(action);
+        action->setChecked(checked);
+    }
+
+    handleTopicsChanged();
+}
+
+void BagPlayerWidget::handlePublishersClicked(void)
+{
+    QStringList topics;
+    for (const auto* action : _topic_actions)
+        topics.append(action->data().toString());
+
+    QPublisherOptionsDialog dialog(topics, _publisher_options, this);
+    if (dialog.exec() == QDialog::Accepted)
+        setPublisherOptions(dialog.options());
+}
+
+void BagPlayerWidget::handleExportClicked(void)
+{
+    auto filename = QFileDialog::getSaveFileName(
+            this,
+            tr("Export the range to"),
+            QDir::homePath(),
+            tr("Bag file (*.bag)"),
+            nullptr,
+            QFileDialog::DontUseNativeDialog);
+    if (filename.isEmpty())
+        return;
+
+    if (!filename.endsWith(".bag"))
+        filename += ".bag";
+
+    // Overwriting one of the played bags would corrupt the playback
+    const auto path = QFileInfo(filename).absoluteFilePath();
+    if (_bags.contains(path)) {
+        receiveStatusText("The range can not be exported into a played bag");
+        return;
+    }
+
+    Q_EMIT sendExportRange(path);
+}
+
+void BagPlayerWidget::receiveExportProgress(const int progress)
+{
+    _exporting = progress < 100;
+    _ui->export_button->setEnabled(!_exporting);
+    _ui->status_bar->setValue(progress);
+}
+
+void BagPlayerWidget::receiveTimelineDensity(const TimelineDensity density)
+{
+    _progress_bar->setDensity(density.messages, density.bytes);
+}
+
+void BagPlayerWidget::setPublisherOptions(const PublisherOptions& options)
+{
+    _publisher_options = options;
+    Q_EMIT sendSetPublisherOptions(options);
+}
+
+PlayerSession BagPlayerWidget::session(void) const
+{
+    PlayerSession session;
+    session.bags           = _bags;
+    session.speed          = _ui->playspeed_spinbox->value();
+    session.loop           = _ui->loop_button->isChecked();
+    session.range_start    = _range_start;
+    session.range_end      = _range_end;
+    session.chunk_cache_mb = _chunk_cache_mb;
+
+    // No topic is saved if they are all selected, so new topics are played too
+    for (const auto* action : _topic_actions) {
+        if (action->isChecked())
+            session.topics.append(action->data().toString());
+    }
+    session.all_topics = session.topics.size() == _topic_actions.size();
+    if (session.all_topics)
+        session.topics.clear();
+
+    return session;
+}
+
+void BagPlayerWidget::restoreSession(const PlayerSession& session, const bool auto_load)
+{
+    if (session.chunk_cache_mb >= 0.0) {
+        _chunk_cache_mb = session.chunk_cache_mb;
+        Q_EMIT sendSetChunkCacheSize(_chunk_cache_mb);
+    }
+
+    // Kept to be saved again, even if they are not loaded
+    _bags = session.bags;
+    if (!auto_load || session.bags.isEmpty())
+        return;
+
+    QStringList filenames;
+    for (const auto& file : session.bags) {
+        // A remote bag is only checked when it is opened
+        if (BagSource::isRemote(file.toStdString())) {
+            filenames.append(file);
+            continue;
+        }
+
+        const QFileInfo filename(file);
+        if (!filename.exists()) {
+            ROS_WARN_STREAM("File: '" << file.toStdString() << "' of the last session does not exist!");
+            continue;
+        }
+        filenames.append(filename.absoluteFilePath());
+    }
+
+    if (filenames.isEmpty()) {
+        receiveStatusText("The bags of the last session do not exist");
+        return;
+    }
+
+    _pending_session = session;
+    _session_pending = true;
+    _bags            = filenames;
+    Q_EMIT sendLoadBags(filenames);
+}
+
+void BagPlayerWidget::applySession(void)
+{
+    _session_pending = false;
+
+    if (!_pending_session.all_topics) {
+        for (auto* action : _topic_actions) {
+            const QSignalBlocker blocker(action);
+            action->setChecked(_pending_session.topics.contains(action->data().toString()));
+        }
+        handleTopicsChanged();
+    }
+
+    if (_pending_session.speed != 0.0)
+        _ui->playspeed_spinbox->setValue(_pending_session.speed);
+
+    // The player clamps the range to the bags
+    if (!_pending_session.range_start.isZero() || !_pending_session.range_end.isZero())
+        Q_EMIT sendSetRange(
+                _pending_session.range_start,
+                _pending_session.range_end.isZero() ? ros::TIME_MAX : _pending_session.range_end);
+
+    _ui->loop_button->setChecked(_pending_session.loop);
+}
+
+void BagPlayerWidget::receiveTopics(const QStringList topics)
+{
+    _topics_menu->clear();
+    _topic_actions.clear();
+
+    // The step topic is kept across loads of bags with the same topics
+    const auto step_topic = _ui->step_topic_combo->currentText();
+    _ui->step_topic_combo->clear();
+    _ui->step_topic_combo->addItems(topics);
+    if (topics.contains(step_topic))
+        _ui->step_topic_combo->setCurrentText(step_topic);
+
+    // The player shows all the selected topics again for the new bags
+    _progress_bar->setDensityTopics(topics);
+
+    if (topics.isEmpty()) {
+        _ui->topics_button->setText("Topics");
+        return;
+    }
+
+    const auto* select_all  = _topics_menu->addAction("Select all");
+    const auto* select_none = _topics_menu->addAction("Select none");
+    connect(select_all, &QAction::triggered, this, [this]() { handleSelectAllTopics(true); });
+    connect(select_none, &QAction::triggered, this, [this]() { handleSelectAllTopics(false); });
+    _topics_menu->addSeparator();
+
+    for (const auto& topic : topics) {
+        auto* action = _topics_menu->addAction(topic);
+        action->setData(topic);
+        action->setCheckable(true);
+        action->setChecked(true);
+        connect(action, &QAction::toggled, this, &BagPlayerWidget::handleTopicsChanged);
+        _topic_actions.append(action);
+    }
+
+    _ui->topics_button->setText(QString("Topics (%1/%1)").arg(topics.size()));
+
+    if (_session_pending)
+        applySession();
 }
 
 void BagPlayerWidget::receiveFileSizeLabel(const QString size)
@@ -125,49 +423,128 @@ void BagPlayerWidget::receiveStatusText(const QString text)
         _ui->status_bar->setTextVisible(false);
 }
 
-void BagPlayerWidget::receiveStampLabel(const QString stamp)
+void BagPlayerWidget::receivePlayheadState(const PlayheadState state)
 {
-    if (!stamp.isEmpty())
-        _ui->stamp_label->setText(stamp + "s");
-    else
-        _ui->stamp_label->clear();
-}
+    if (!state.valid) {
+        const QSignalBlocker start_blocker(_ui->range_start_button);
+        const QSignalBlocker end_blocker(_ui->range_end_button);
+        _ui->range_start_button->setChecked(false);
+        _ui->range_end_button->setChecked(false);
 
-void BagPlayerWidget::receiveDateLabel(const QString date)
-{
-    if (!date.isEmpty())
-        _ui->date_label->setText(date);
-    else
+        _ui->stamp_label->clear();
         _ui->date_label->clear();
-}
+        _ui->seconds_label->clear();
+        _progress_bar->setProgress(0.0);
+        _progress_bar->setMarkers(-1.0, -1.0);
+        _ui->throughput_label->clear();
+        _ui->throughput_label->setToolTip("");
+        _ui->load_label->clear();
+
+        _range_start = ros::Time();
+        _range_end   = ros::Time();
+        return;
+    }
 
-void BagPlayerWidget::receivePlayspeedLabel(const QString speed)
-{
-    if (!speed.isEmpty())
-        _ui->playspeed_label->setText(speed);
-    else
-        _ui->playspeed_label->clear();
+    const auto duration = state.bag_end.toSec() - state.bag_start.toSec();
+    const auto progress = state.stamp.toSec() - state.bag_start.toSec();
+
+    _ui->stamp_label->setText(QString::number(state.stamp.toSec(), 'f', 9) + "s");
+    _ui->date_label->setText(
+            QDateTime::fromSecsSinceEpoch(state.stamp.sec, Qt::UTC).toString("dd.MM.yyyy hh::mm::ss"));
+    _ui->seconds_label->setText(QString::number(progress, 'f', 2) + "/" + QString::number(duration, 'f', 2) + "s");
+    _progress_bar->setProgress(duration > 0.0 ? progress / duration : 0.0);
+
+    // The range is set by the player, which may move a bound back to the bag edge
+    const bool has_start = state.range_start != state.bag_start;
+    const bool has_end   = state.range_end != state.bag_end;
+    _range_start         = has_start ? state.range_start : ros::Time();
+    _range_end           = has_end ? state.range_end : ros::Time();
+    {
+        const QSignalBlocker start_blocker(_ui->range_start_button);
+        const QSignalBlocker end_blocker(_ui->range_end_button);
+        _ui->range_start_button->setChecked(has_start);
+        _ui->range_end_button->setChecked(has_end);
+    }
+    if (duration > 0.0)
+        _progress_bar->setMarkers(
+                has_start ? (state.range_start - state.bag_start).toSec() / duration : -1.0,
+                has_end ? (state.range_end - state.bag_start).toSec() / duration : -1.0);
+
+    auto throughput = QString("%1 msg/s %2 MB/s")
+                              .arg(state.message_rate, 0, 'f', 0)
+                              .arg(state.byte_rate / (1024 * 1024), 0, 'f', 1);
+    if (state.dropped_messages > 0)
+        throughput += QString(", %1 dropped").arg(state.dropped_messages);
+    _ui->throughput_label->setText(throughput);
+
+    auto tooltip = QString("Published messages and data per second\n"
+                           "Read-ahead: %1/%2 messages\nMax lateness: %3 ms\nLateness since load:")
+                           .arg(state.queue_depth)
+                           .arg(state.queue_capacity)
+                           .arg(state.max_lateness * 1000.0, 0, 'f', 1);
+    for (std::size_t bin = 0; bin < LATENESS_BINS; ++bin) {
+        const auto range = bin < LATENESS_BIN_LIMITS_MS.size()
+                                   ? QString("< %1 ms").arg(LATENESS_BIN_LIMITS_MS[bin])
+                                   : QString(">= %1 ms").arg(LATENESS_BIN_LIMITS_MS.back());
+        tooltip += QString("\n  %1: %2").arg(range).arg(state.lateness_histogram[bin]);
+    }
+    tooltip += QString("\nDropped late messages: %1").arg(state.dropped_messages);
+    _ui->throughput_label->setToolTip(tooltip);
+
+    // Shares of one thread, the decompression may use several
+    _ui->load_label->setText(QString("disk %1% decode %2% publish %3%")
+                                     .arg(state.read_load * 100.0, 0, 'f', 0)
+                                     .arg(state.decode_load * 100.0, 0, 'f', 0)
+                                     .arg(state.publish_load * 100.0, 0, 'f', 0));
+    _ui->load_label->setToolTip(QString("Time spent per second of playback, summed over the threads\n"
+                                        "Reading the bag files: %1 ms (%2 MB/s)\n"
+                                        "Decompressing the chunks: %3 ms\nPublishing: %4 ms")
+                                        .arg(state.read_load * 1000.0, 0, 'f', 1)
+                                        .arg(state.read_rate / (1024 * 1024), 0, 'f', 1)
+                                        .arg(state.decode_load * 1000.0, 0, 'f', 1)
+                                        .arg(state.publish_load * 1000.0, 0, 'f', 1));
 }
 
-void BagPlayerWidget::receiveSecondsLabel(const QString seconds)
+void BagPlayerWidget::receivePlaybackSpeed(const double speed, const bool unthrottled)
 {
-    if (!seconds.isEmpty())
-        _ui->seconds_label->setText(seconds);
-    else
-        _ui->seconds_label->clear();
+    // The player echoes the speed it applied, which must not be sent back
+    const QSignalBlocker spinbox_blocker(_ui->playspeed_spinbox);
+    const QSignalBlocker button_blocker(_ui->max_speed_button);
+
+    _ui->playspeed_spinbox->setValue(speed != 0.0 ? speed : 1.0);
+    _ui->max_speed_button->setChecked(unthrottled);
 }
 
 void BagPlayerWidget::receiveEnableActionButtons(const bool enable)
 {
     QList<QPushButton*> actionButtons = this->findChildren<QPushButton*>();
     for (const auto& btn : actionButtons) {
-        if (btn != _ui->load_button)
+        if (btn != _ui->load_button && btn != _ui->url_button)
             btn->setEnabled(enable);
     }
+    _ui->export_button->setEnabled(enable && !_exporting);
 
+    _ui->playspeed_spinbox->setEnabled(enable);
+    _ui->step_topic_combo->setEnabled(enable);
+    _ui->step_count_spinbox->setEnabled(enable);
     _progress_bar->setEnabled(enable);
 }
 
+void BagPlayerWidget::receiveEnableSeekControls(const bool enable)
+{
+    _ui->begin_button->setEnabled(enable);
+    _ui->end_button->setEnabled(enable);
+    _ui->slower_button->setEnabled(enable);
+    _ui->step_back_button->setEnabled(enable);
+    _ui->step_forward_button->setEnabled(enable);
+    _progress_bar->setEnabled(enable);
+}
+
+void BagPlayerWidget::receiveLoadProgress(const int progress)
+{
+    _ui->status_bar->setValue(progress);
+}
+
 void BagPlayerWidget::receiveBagFinished(void)
 {
     _ui->play_button->setIcon(QIcon::fromTheme("media-playback-start"));
@@ -187,7 +564,7 @@ void BagPlayerWidget::stopPlaying(void)
 
 void BagPlayerWidget::connectSignals(void)
 {
-    connect(this, &BagPlayerWidget::sendLoadBag, _player.get(), &QBagPlayer::receiveLoadBag, Qt::QueuedConnection);
+    connect(this, &BagPlayerWidget::sendLoadBags, _player.get(), &QBagPlayer::receiveLoadBags, Qt::QueuedConnection);
     connect(this,
             &BagPlayerWidget::sendStartPlaying,
             _player.get(),
@@ -202,6 +579,45 @@ void BagPlayerWidget::connectSignals(void)
     connect(this, &BagPlayerWidget::sendSetEnd, _player.get(), &QBagPlayer::receiveSetEnd, Qt::QueuedConnection);
     connect(this, &BagPlayerWidget::sendFaster, _player.get(), &QBagPlayer::receiveChangeSpeed, Qt::QueuedConnection);
     connect(this, &BagPlayerWidget::sendSlower, _player.get(), &QBagPlayer::receiveChangeSpeed, Qt::QueuedConnection);
+    connect(this, &BagPlayerWidget::sendSetSpeed, _player.get(), &QBagPlayer::receiveSetSpeed, Qt::QueuedConnection);
+    connect(this,
+            &BagPlayerWidget::sendSelectTopics,
+            _player.get(),
+            &QBagPlayer::receiveSelectTopics,
+            Qt::QueuedConnection);
+    connect(this, &BagPlayerWidget::sendStep, _player.get(), &QBagPlayer::receiveStep, Qt::QueuedConnection);
+    connect(this,
+            &BagPlayerWidget::sendSetRangeStart,
+            _player.get(),
+            &QBagPlayer::receiveSetRangeStart,
+            Qt::QueuedConnection);
+    connect(this,
+            &BagPlayerWidget::sendSetRangeEnd,
+            _player.get(),
+            &QBagPlayer::receiveSetRangeEnd,
+            Qt::QueuedConnection);
+    connect(this, &BagPlayerWidget::sendSetLoop, _player.get(), &QBagPlayer::receiveSetLoop, Qt::QueuedConnection);
+    connect(this,
+            &BagPlayerWidget::sendSetPublisherOptions,
+            _player.get(),
+            &QBagPlayer::receiveSetPublisherOptions,
+            Qt::QueuedConnection);
+    connect(this, &BagPlayerWidget::sendSetRange, _player.get(), &QBagPlayer::receiveSetRange, Qt::QueuedConnection);
+    connect(this,
+            &BagPlayerWidget::sendSetChunkCacheSize,
+            _player.get(),
+            &QBagPlayer::receiveSetChunkCacheSize,
+            Qt::QueuedConnection);
+    connect(this,
+            &BagPlayerWidget::sendExportRange,
+            _player.get(),
+            &QBagPlayer::receiveExportRange,
+            Qt::QueuedConnection);
+    connect(this,
+            &BagPlayerWidget::sendSetUnthrottled,
+            _player.get(),
+            &QBagPlayer::receiveSetUnthrottled,
+            Qt::QueuedConnection);
 
     connect(_ui->end_button, &QPushButton::clicked, _player.get(), &QBagPlayer::receiveGotoEnd, Qt::QueuedConnection);
     connect(_ui->begin_button,
@@ -213,6 +629,11 @@ void BagPlayerWidget::connectSignals(void)
             &QCustomProgressBar::sendClickedProgress,
             _player.get(),
             &QBagPlayer::receiveClickedProgress);
+    connect(_progress_bar.get(),
+            &QCustomProgressBar::sendDensityTopic,
+            _player.get(),
+            &QBagPlayer::receiveSetDensityTopic,
+            Qt::QueuedConnection);
 
     connect(_player.get(),
             &QBagPlayer::sendBagFinished,
@@ -225,20 +646,14 @@ void BagPlayerWidget::connectSignals(void)
             &BagPlayerWidget::receiveFileSizeLabel,
             Qt::QueuedConnection);
     connect(_player.get(),
-            &QBagPlayer::sendStampLabel,
+            &QBagPlayer::sendPlayheadState,
             this,
-            &BagPlayerWidget::receiveStampLabel,
+            &BagPlayerWidget::receivePlayheadState,
             Qt::QueuedConnection);
-    connect(_player.get(), &QBagPlayer::sendDateLabel, this, &BagPlayerWidget::receiveDateLabel, Qt::QueuedConnection);
     connect(_player.get(),
-            &QBagPlayer::sendPlayspeedLabel,
+            &QBagPlayer::sendPlaybackSpeed,
             this,
-            &BagPlayerWidget::receivePlayspeedLabel,
-            Qt::QueuedConnection);
-    connect(_player.get(),
-            &QBagPlayer::sendSecondsLabel,
-            this,
-            &BagPlayerWidget::receiveSecondsLabel,
+            &BagPlayerWidget::receivePlaybackSpeed,
             Qt::QueuedConnection);
     connect(_player.get(),
             &QBagPlayer::sendStatusText,
@@ -251,9 +666,25 @@ void BagPlayerWidget::connectSignals(void)
             &BagPlayerWidget::receiveEnableActionButtons,
             Qt::QueuedConnection);
     connect(_player.get(),
-            &QBagPlayer::sendPlayheadProgress,
-            _progress_bar.get(),
-            &QCustomProgressBar::setValue,
+            &QBagPlayer::sendEnableSeekControls,
+            this,
+            &BagPlayerWidget::receiveEnableSeekControls,
+            Qt::QueuedConnection);
+    connect(_player.get(),
+            &QBagPlayer::sendLoadProgress,
+            this,
+            &BagPlayerWidget::receiveLoadProgress,
+            Qt::QueuedConnection);
+    connect(_player.get(), &QBagPlayer::sendTopics, this, &BagPlayerWidget::receiveTopics, Qt::QueuedConnection);
+    connect(_player.get(),
+            &QBagPlayer::sendExportProgress,
+            this,
+            &BagPlayerWidget::receiveExportProgress,
+            Qt::QueuedConnection);
+    connect(_player.get(),
+            &QBagPlayer::sendTimelineDensity,
+            this,
+            &BagPlayerWidget::receiveTimelineDensity,
             Qt::QueuedConnection);
 }
 
@@ -4,8 +4,10 @@
 #include <QHBoxLayout>
 #include <QPushButton>
 #include <QVBoxLayout>
+#include <algorithm>
 
 #include "rosbag_rviz_panel/BagPlayerWidget.h"
+#include "rosbag_rviz_panel/BagSource.h"
 
 namespace rosbag_rviz_panel {
 RosbagRvizPanel::RosbagRvizPanel(QWidget* parent) : rviz::Panel(parent)
@@ -33,11 +35,95 @@ void RosbagRvizPanel::setupPanelLayout()
 void RosbagRvizPanel::load(const rviz::Config& config)
 {
     rviz::Panel::load(config);
+
+    // A missing key keeps the value of the player parameters
+    auto    options = _widget->publisherOptions();
+    QString prefix;
+    int     queue_size;
+    if (config.mapGetString("Topic prefix", &prefix))
+        options.prefix = prefix.toStdString();
+    if (config.mapGetInt("Queue size", &queue_size))
+        options.queue_size = static_cast<uint32_t>(std::max(queue_size, 0));
+
+    const auto queue_sizes = config.mapGetChild("Queue sizes");
+    if (queue_sizes.getType() == rviz::Config::Map) {
+        options.queue_sizes.clear();
+        for (auto topic = queue_sizes.mapIterator(); topic.isValid(); topic.advance()) {
+            bool       valid = false;
+            const auto size  = topic.currentChild().getValue().toInt(&valid);
+            if (valid && size >= 0)
+                options.queue_sizes[topic.currentKey().toStdString()] = static_cast<uint32_t>(size);
+        }
+    }
+
+    _widget->setPublisherOptions(options);
+
+    // The bags of the last session are loaded again unless "Auto load" is false
+    PlayerSession session;
+    float         speed;
+    float         chunk_cache_mb;
+    bool          loop;
+    bool          all_topics;
+    bool          auto_load = true;
+    QString       stamp;
+    if (config.mapGetFloat("Speed", &speed))
+        session.speed = speed;
+    if (config.mapGetBool("Loop", &loop))
+        session.loop = loop;
+    if (config.mapGetFloat("Chunk cache MB", &chunk_cache_mb) && chunk_cache_mb >= 0.0f)
+        session.chunk_cache_mb = chunk_cache_mb;
+    if (config.mapGetString("Range start", &stamp))
+        session.range_start.fromNSec(stamp.toULongLong());
+    if (config.mapGetString("Range end", &stamp))
+        session.range_end.fromNSec(stamp.toULongLong());
+    config.mapGetBool("Auto load", &auto_load);
+
+    const auto bags = config.mapGetChild("Bags");
+    for (int i = 0; bags.getType() == rviz::Config::List && i < bags.listLength(); ++i)
+        session.bags.append(bags.listChildAt(i).getValue().toString());
+
+    const auto topics = config.mapGetChild("Topics");
+    for (int i = 0; topics.getType() == rviz::Config::List && i < topics.listLength(); ++i)
+        session.topics.append(topics.listChildAt(i).getValue().toString());
+
+    // Without the marker, as saved by older versions, no topic list means that they were all selected
+    session.all_topics = config.mapGetBool("All topics", &all_topics) ? all_topics : session.topics.isEmpty();
+
+    _widget->restoreSession(session, auto_load);
 }
 
 void RosbagRvizPanel::save(rviz::Config config) const
 {
     rviz::Panel::save(config);
+
+    const auto& options = _widget->publisherOptions();
+    config.mapSetValue("Topic prefix", QString::fromStdString(options.prefix));
+    config.mapSetValue("Queue size", static_cast<int>(options.queue_size));
+
+    auto queue_sizes = config.mapMakeChild("Queue sizes");
+    for (const auto& topic : options.queue_sizes)
+        queue_sizes.mapSetValue(QString::fromStdString(topic.first), static_cast<int>(topic.second));
+
+    // The time stamps are saved in nanoseconds, which a float cannot hold
+    const auto session = _widget->session();
+    config.mapSetValue("Speed", session.speed);
+    config.mapSetValue("Loop", session.loop);
+    config.mapSetValue("Chunk cache MB", session.chunk_cache_mb);
+    config.mapSetValue("Range start", QString::number(session.range_start.toNSec()));
+    config.mapSetValue("Range end", QString::number(session.range_end.toNSec()));
+
+    // The query of a URL may hold the credentials of a presigned URL, it is not written to the file
+    auto bags = config.mapMakeChild("Bags");
+    for (const auto& bag : session.bags)
+        bags.listAppendNew().setValue(QString::fromStdString(BagSource::stripQuery(bag.toStdString())));
+
+    // The marker tells all the topics from none, an empty list could not be told from a missing one
+    config.mapSetValue("All topics", session.all_topics);
+    if (!session.all_topics) {
+        auto topics = config.mapMakeChild("Topics");
+        for (const auto& topic : session.topics)
+            topics.listAppendNew().setValue(topic);
+    }
 }
 } // namespace rosbag_rviz_panel
 
@@ -0,0 +1,74 @@
+#include "rosbag_rviz_panel/PlayerNodelet.h"
+
+#include <pluginlib/class_list_macros.h>
+
+#include <string>
+#include <vector>
+
+namespace rosbag_rviz_panel {
+
+PlayerNodelet::~PlayerNodelet()
+{
+    // No callback may run once the player is destroyed
+    _pause_service.shutdown();
+    _update_timer.stop();
+}
+
+void PlayerNodelet::onInit(void)
+{
+    auto& private_nh = getPrivateNodeHandle();
+
+    std::vector<std::string> bags, topics;
+    double                   speed       = 1.0;
+    bool                     unthrottled = false;
+    bool                     loop        = false;
+    bool                     autostart   = true;
+    private_nh.param("bags", bags, bags);
+    private_nh.param("topics", topics, topics);
+    private_nh.param("speed", speed, speed);
+    private_nh.param("unthrottled", unthrottled, unthrottled);
+    private_nh.param("loop", loop, loop);
+    private_nh.param("autostart", autostart, autostart);
+
+    if (bags.empty()) {
+        NODELET_ERROR_STREAM("No bag to play, set the bags parameter");
+        return;
+    }
+
+    // The player logs its own status, the topics are advertised from the manager so its subscribers are intra-process
+    _player = std::make_unique<BagPlayer>(nullptr, private_nh);
+    if (!_player->load(bags))
+        return;
+
+    if (!topics.empty())
+        _player->selectTopics(topics);
+    _player->setSpeed(speed);
+    _player->setUnthrottled(unthrottled);
+    _player->setLoop(loop);
+    if (autostart)
+        _player->play();
+
+    _update_timer = getNodeHandle().createWallTimer(
+            ros::WallDuration(1.0 / _player->uiUpdateRate()), &PlayerNodelet::update, this);
+    _pause_service = private_nh.advertiseService("pause_playback", &PlayerNodelet::pausePlayback, this);
+}
+
+void PlayerNodelet::update(const ros::WallTimerEvent& /* event */)
+{
+    _player->update();
+}
+
+bool PlayerNodelet::pausePlayback(std_srvs::SetBool::Request& req, std_srvs::SetBool::Response& res)
+{
+    if (req.data)
+        _player->pause();
+    else
+        _player->play();
+
+    res.success = true;
+    res.message = req.data ? "Playback paused" : "Playback resumed";
+    return true;
+}
+} // namespace rosbag_rviz_panel
+
+PLUGINLIB_EXPORT_CLASS(rosbag_rviz_panel::PlayerNodelet, nodelet::Nodelet)
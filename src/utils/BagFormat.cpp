@@ -0,0 +1,132 @@
+#include "rosbag_rviz_panel/BagFormat.h"
+
+#include <cstring>
+#include <vector>
+
+namespace rosbag_rviz_panel {
+namespace bag_format {
+
+namespace {
+
+const std::string& findField(const FieldMap& fields, const std::string& name, const std::size_t size)
+{
+    const auto it = fields.find(name);
+    if (it == fields.end())
+        throw rosbag::BagFormatException("Required '" + name + "' field missing");
+
+    if (it->second.size() != size)
+        throw rosbag::BagFormatException("Field '" + name + "' has an unexpected size");
+
+    return it->second;
+}
+
+} // namespace
+
+Record readRecord(const BagSource& source, uint64_t pos)
+{
+    uint32_t header_len;
+    source.read(pos, &header_len, sizeof(header_len));
+    pos += sizeof(header_len);
+
+    // A corrupted length must not allocate more than the bag holds
+    if (header_len + sizeof(uint32_t) > source.size() - pos)
+        throw rosbag::BagFormatException("Record header out of the bag file");
+
+    std::vector<uint8_t> header(header_len);
+    source.read(pos, header.data(), header_len);
+    pos += header_len;
+
+    Record record;
+    record.fields = parseHeader(header.data(), header_len);
+
+    source.read(pos, &record.data_len, sizeof(record.data_len));
+    record.data_pos = pos + sizeof(record.data_len);
+
+    return record;
+}
+
+Record readRecord(const uint8_t* file, const std::size_t size, uint64_t pos)
+{
+    uint32_t header_len;
+    if (pos + sizeof(header_len) > size)
+        throw rosbag::BagFormatException("Record out of the bag file");
+    std::memcpy(&header_len, file + pos, sizeof(header_len));
+    pos += sizeof(header_len);
+
+    if (pos + header_len + sizeof(uint32_t) > size)
+        throw rosbag::BagFormatException("Record header out of the bag file");
+
+    Record record;
+    record.fields = parseHeader(file + pos, header_len);
+    pos += header_len;
+
+    std::memcpy(&record.data_len, file + pos, sizeof(record.data_len));
+    record.data_pos = pos + sizeof(record.data_len);
+    if (record.nextPos() > size)
+        throw rosbag::BagFormatException("Record data out of the bag file");
+
+    return record;
+}
+
+FieldMap parseHeader(const uint8_t* data, uint32_t len)
+{
+    FieldMap fields;
+
+    const uint8_t* const end = data + len;
+    while (data < end) {
+        if (static_cast<std::size_t>(end - data) < sizeof(uint32_t))
+            throw rosbag::BagFormatException("Truncated record header");
+
+        uint32_t field_len;
+        std::memcpy(&field_len, data, sizeof(field_len));
+        data += sizeof(field_len);
+
+        if (field_len > static_cast<std::size_t>(end - data))
+            throw rosbag::BagFormatException("Record header field exceeds the header length");
+
+        const auto* field = reinterpret_cast<const char*>(data);
+        const auto* sep   = static_cast<const char*>(std::memchr(field, '=', field_len));
+        if (sep == nullptr)
+            throw rosbag::BagFormatException("Record header field without '='");
+
+        fields[std::string(field, sep)] = std::string(sep + 1, field + field_len);
+        data += field_len;
+    }
+
+    return fields;
+}
+
+uint8_t readOp(const FieldMap& fields)
+{
+    return static_cast<uint8_t>(findField(fields, "op", sizeof(uint8_t))[0]);
+}
+
+uint32_t readUInt32(const FieldMap& fields, const std::string& name)
+{
+    uint32_t value;
+    std::memcpy(&value, findField(fields, name, sizeof(value)).data(), sizeof(value));
+    return value;
+}
+
+uint64_t readUInt64(const FieldMap& fields, const std::string& name)
+{
+    uint64_t value;
+    std::memcpy(&value, findField(fields, name, sizeof(value)).data(), sizeof(value));
+    return value;
+}
+
+ros::Time readTime(const FieldMap& fields, const std::string& name)
+{
+    return decodeTime(reinterpret_cast<const uint8_t*>(findField(fields, name, 2 * sizeof(uint32_t)).data()));
+}
+
+ros::Time decodeTime(const uint8_t* data)
+{
+    uint32_t sec, nsec;
+    std::memcpy(&sec, data, sizeof(sec));
+    std::memcpy(&nsec, data + sizeof(sec), sizeof(nsec));
+    return ros::Time(sec, nsec);
+}
+
+} // namespace bag_format
+} // namespace rosbag_rviz_panel
@@ -0,0 +1,676 @@
+#include "rosbag_rviz_panel/BagIndex.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <boost/make_shared.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <type_traits>
+
+#include "rosbag_rviz_panel/BagFormat.h"
+#include "rosbag_rviz_panel/BagSource.h"
+
+namespace rosbag_rviz_panel {
+
+namespace {
+
+/**
+ * @brief Closes the file descriptor when leaving the scope.
+ */
+struct FileGuard
+{
+    int fd;
+    ~FileGuard()
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+};
+
+/**
+ * @brief Index data entry, used only while sorting the messages.
+ */
+struct IndexEntry
+{
+    ros::Time stamp;
+    uint32_t  connection_id;
+    uint32_t  chunk_id;
+    uint32_t  offset;
+};
+
+constexpr std::size_t INDEX_ENTRY_SIZE = 3 * sizeof(uint32_t);
+
+constexpr char     SIDECAR_MAGIC[8] = {'R', 'B', 'R', 'P', 'I', 'D', 'X', '\0'};
+constexpr uint32_t SIDECAR_VERSION  = 3;
+
+static_assert(
+        sizeof(ros::Time) == 2 * sizeof(uint32_t) && std::is_trivially_copyable<ros::Time>::value,
+        "ros::Time must match its <sec><nsec> serialization to be mapped from the sidecar");
+
+/**
+ * @brief Fixed size header of the sidecar file. It is followed by the
+ * bag path, the bag version, the chunks, the connections and the
+ * message arrays.
+ */
+struct SidecarHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t path_size;
+    uint64_t bag_size;
+    uint64_t bag_version_size;
+    uint64_t chunk_count;
+    uint64_t connections_size;
+    uint64_t message_count;
+    uint64_t index_pos;
+};
+
+/**
+ * @brief Serialized BagIndex::ChunkInfo.
+ */
+struct SidecarChunk
+{
+    uint32_t start_sec;
+    uint32_t start_nsec;
+    uint32_t end_sec;
+    uint32_t end_nsec;
+    uint64_t pos;
+    uint32_t connection_count;
+    uint32_t message_count;
+};
+
+std::size_t align8(const std::size_t size)
+{
+    return (size + 7) & ~static_cast<std::size_t>(7);
+}
+
+void writeString(std::ostream& out, const std::string& str)
+{
+    const auto size = static_cast<uint32_t>(str.size());
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    out.write(str.data(), size);
+}
+
+/**
+ * @brief Bounds checked cursor over the mapped sidecar.
+ */
+struct SidecarCursor
+{
+    const uint8_t* pos;
+    const uint8_t* end;
+
+    const uint8_t* take(const std::size_t size)
+    {
+        if (size > static_cast<std::size_t>(end - pos))
+            throw rosbag::BagFormatException("Truncated sidecar index");
+
+        const auto* data = pos;
+        pos += size;
+        return data;
+    }
+
+    uint32_t takeUInt32()
+    {
+        uint32_t value;
+        std::memcpy(&value, take(sizeof(value)), sizeof(value));
+        return value;
+    }
+
+    std::string takeString()
+    {
+        const auto size = takeUInt32();
+        return std::string(reinterpret_cast<const char*>(take(size)), size);
+    }
+};
+
+std::string cacheDirectory(void)
+{
+    std::string dir;
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"))
+        dir = xdg;
+    else if (const char* home = std::getenv("HOME"))
+        dir = std::string(home) + "/.cache";
+    else
+        dir = "/tmp";
+
+    return dir + "/rosbag_rviz_panel";
+}
+
+rosbag::ConnectionInfo makeConnection(const uint32_t id, const std::string& topic, const bag_format::FieldMap& header)
+{
+    rosbag::ConnectionInfo info;
+    info.id    = id;
+    info.topic = topic;
+
+    const auto field = [&header](const std::string& name) {
+        const auto it = header.find(name);
+        return it != header.end() ? it->second : std::string();
+    };
+    info.datatype = field("type");
+    info.md5sum   = field("md5sum");
+    info.msg_def  = field("message_definition");
+    info.header   = boost::make_shared<ros::M_string>(header.begin(), header.end());
+
+    return info;
+}
+
+rosbag::ConnectionInfo readConnection(const BagSource& source, const bag_format::Record& record)
+{
+    std::vector<uint8_t> data(record.data_len);
+    source.read(record.data_pos, data.data(), data.size());
+
+    const auto topic = record.fields.find("topic");
+    return makeConnection(
+            bag_format::readUInt32(record.fields, "conn"),
+            topic != record.fields.end() ? topic->second : std::string(),
+            bag_format::parseHeader(data.data(), record.data_len));
+}
+
+} // namespace
+
+BagIndex::~BagIndex()
+{
+    clear();
+}
+
+void BagIndex::open(const std::string& filename)
+{
+    clear();
+
+    const auto source = BagSource::open(filename);
+
+    char version[bag_format::VERSION_LINE_LENGTH];
+    source->read(0, version, sizeof(version));
+    if (std::memcmp(version, bag_format::VERSION_LINE, sizeof(version)) != 0)
+        throw rosbag::BagFormatException("Only rosbag V2.0 files are supported: " + BagSource::stripQuery(filename));
+
+    const auto header = bag_format::readRecord(*source, sizeof(version));
+    if (bag_format::readOp(header.fields) != bag_format::OP_FILE_HEADER)
+        throw rosbag::BagFormatException("Expected FILE_HEADER op not found");
+
+    const auto index_pos   = bag_format::readUInt64(header.fields, "index_pos");
+    const auto chunk_count = bag_format::readUInt32(header.fields, "chunk_count");
+    if (index_pos == 0)
+        throw rosbag::BagUnindexedException();
+
+    _file_size    = source->size();
+    _index_pos    = index_pos;
+    _file_version = source->version();
+    _chunks.reserve(chunk_count);
+
+    // The index section holds the connection records followed by one chunk info record per chunk
+    std::vector<uint8_t> data;
+    for (uint64_t pos = index_pos; pos < _file_size;) {
+        const auto record = bag_format::readRecord(*source, pos);
+        pos               = record.nextPos();
+
+        const auto op = bag_format::readOp(record.fields);
+        if (op == bag_format::OP_CONNECTION) {
+            auto info             = readConnection(*source, record);
+            _connections[info.id] = std::move(info);
+            continue;
+        }
+
+        if (op != bag_format::OP_CHUNK_INFO)
+            continue;
+
+        ChunkInfo chunk;
+        chunk.pos              = bag_format::readUInt64(record.fields, "chunk_pos");
+        chunk.start_time       = bag_format::readTime(record.fields, "start_time");
+        chunk.end_time         = bag_format::readTime(record.fields, "end_time");
+        chunk.connection_count = bag_format::readUInt32(record.fields, "count");
+
+        // Data holds <conn><count> pairs for every connection in the chunk
+        data.resize(record.data_len);
+        source->read(record.data_pos, data.data(), data.size());
+        for (std::size_t i = 0; i + 2 * sizeof(uint32_t) <= data.size(); i += 2 * sizeof(uint32_t)) {
+            uint32_t count;
+            std::memcpy(&count, data.data() + i + sizeof(uint32_t), sizeof(count));
+            chunk.message_count += count;
+        }
+
+        _chunks.push_back(chunk);
+    }
+
+    std::sort(_chunks.begin(), _chunks.end(), [](const ChunkInfo& a, const ChunkInfo& b) { return a.pos < b.pos; });
+
+    std::size_t message_count = 0;
+    for (const auto& chunk : _chunks) {
+        if (chunk.message_count == 0)
+            continue;
+
+        if (message_count == 0 || chunk.start_time < _start_time)
+            _start_time = chunk.start_time;
+        if (message_count == 0 || chunk.end_time > _end_time)
+            _end_time = chunk.end_time;
+
+        message_count += chunk.message_count;
+    }
+
+    // The message arrays never reallocate while build() appends to them, so they can be read meanwhile
+    _stamp_storage.reserve(message_count);
+    _connection_id_storage.reserve(message_count);
+    _chunk_id_storage.reserve(message_count);
+    _offset_storage.reserve(message_count);
+    useStorage();
+
+    _filename = filename;
+    _building = true;
+}
+
+bool BagIndex::build(const std::function<bool(const float)>& progress)
+{
+    // Whatever happens, the index stops growing when leaving
+    struct BuildGuard
+    {
+        std::atomic<bool>& building;
+        ~BuildGuard() { building = false; }
+    } guard{_building};
+
+    const auto source = BagSource::open(_filename);
+
+    // Chunks are indexed by start time: once a chunk is read, every pending message earlier than the
+    // next chunk start is final and can be appended to the sorted arrays
+    std::vector<uint32_t> order(_chunks.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](const uint32_t a, const uint32_t b) {
+        return _chunks[a].start_time < _chunks[b].start_time;
+    });
+
+    std::vector<IndexEntry> pending;
+    std::vector<uint8_t>    data;
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        if (progress && !progress(static_cast<float>(i) / static_cast<float>(order.size())))
+            return false;
+
+        const auto  chunk_id = order[i];
+        const auto& chunk    = _chunks[chunk_id];
+        const auto  record   = bag_format::readRecord(*source, chunk.pos);
+        if (bag_format::readOp(record.fields) != bag_format::OP_CHUNK)
+            throw rosbag::BagFormatException("Expected CHUNK op not found");
+
+        // Every chunk record is followed by one index data record per connection stored in it
+        uint64_t pos = record.nextPos();
+        for (uint32_t c = 0; c < chunk.connection_count; ++c) {
+            const auto index = bag_format::readRecord(*source, pos);
+            pos              = index.nextPos();
+
+            if (bag_format::readOp(index.fields) != bag_format::OP_INDEX_DATA)
+                throw rosbag::BagFormatException("Expected INDEX_DATA op not found");
+            if (bag_format::readUInt32(index.fields, "ver") != 1)
+                throw rosbag::BagFormatException("Unsupported INDEX_DATA version");
+
+            const auto connection_id = bag_format::readUInt32(index.fields, "conn");
+            const auto count         = bag_format::readUInt32(index.fields, "count");
+            if (static_cast<uint64_t>(count) * INDEX_ENTRY_SIZE > index.data_len)
+                throw rosbag::BagFormatException("Truncated INDEX_DATA record");
+
+            data.resize(static_cast<std::size_t>(count) * INDEX_ENTRY_SIZE);
+            source->read(index.data_pos, data.data(), data.size());
+            for (std::size_t e = 0; e < data.size(); e += INDEX_ENTRY_SIZE) {
+                IndexEntry entry;
+                entry.stamp         = bag_format::decodeTime(data.data() + e);
+                entry.connection_id = connection_id;
+                entry.chunk_id      = chunk_id;
+                std::memcpy(&entry.offset, data.data() + e + 2 * sizeof(uint32_t), sizeof(entry.offset));
+                pending.push_back(entry);
+            }
+        }
+
+        // Messages with the same stamp keep the order in which they were indexed
+        std::stable_sort(pending.begin(), pending.end(), [](const IndexEntry& a, const IndexEntry& b) {
+            return a.stamp < b.stamp;
+        });
+
+        auto ready = pending.end();
+        if (i + 1 < order.size()) {
+            const auto horizon = _chunks[order[i + 1]].start_time;
+            ready              = std::lower_bound(
+                    pending.begin(),
+                    pending.end(),
+                    horizon,
+                    [](const IndexEntry& e, const ros::Time& t) { return e.stamp < t; });
+        }
+
+        const auto ready_count = static_cast<std::size_t>(std::distance(pending.begin(), ready));
+        if (_stamp_storage.size() + ready_count > _stamp_storage.capacity())
+            throw rosbag::BagFormatException("Index data does not match the chunk info records");
+
+        for (auto it = pending.begin(); it != ready; ++it) {
+            _stamp_storage.push_back(it->stamp);
+            _connection_id_storage.push_back(it->connection_id);
+            _chunk_id_storage.push_back(it->chunk_id);
+            _offset_storage.push_back(it->offset);
+        }
+        pending.erase(pending.begin(), ready);
+
+        _size.store(_stamp_storage.size(), std::memory_order_release);
+    }
+
+    indexConnections();
+
+    if (progress)
+        progress(1.0f);
+
+    return true;
+}
+
+bool BagIndex::mapSidecar(const std::string& filename)
+{
+    clear();
+
+    // Opening a remote bag only fetches its first byte, along with its size and version
+    std::unique_ptr<BagSource> bag;
+    try {
+        bag = BagSource::open(filename);
+    } catch (const rosbag::BagException&) {
+        return false;
+    }
+
+    if (BagSource::isRemote(filename) && bag->version().empty())
+        return false;
+
+    FileGuard file{::open(sidecarPath(filename).c_str(), O_RDONLY | O_CLOEXEC)};
+    if (file.fd < 0)
+        return false;
+
+    struct stat sidecar_stat;
+    if (::fstat(file.fd, &sidecar_stat) != 0 || static_cast<std::size_t>(sidecar_stat.st_size) < sizeof(SidecarHeader))
+        return false;
+
+    void* mapping = ::mmap(nullptr, static_cast<std::size_t>(sidecar_stat.st_size), PROT_READ, MAP_SHARED, file.fd, 0);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    _mapping      = mapping;
+    _mapping_size = static_cast<std::size_t>(sidecar_stat.st_size);
+
+    try {
+        const auto*   begin = static_cast<const uint8_t*>(_mapping);
+        SidecarCursor cursor{begin, begin + _mapping_size};
+
+        SidecarHeader header;
+        std::memcpy(&header, cursor.take(sizeof(header)), sizeof(header));
+
+        // A sidecar from another format version or an older copy of the bag is just ignored
+        const auto location = BagSource::stripQuery(filename);
+        if (std::memcmp(header.magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC)) != 0 || header.version != SIDECAR_VERSION
+            || header.bag_size != bag->size()
+            || std::string(reinterpret_cast<const char*>(cursor.take(header.path_size)), header.path_size) != location
+            || std::string(reinterpret_cast<const char*>(cursor.take(header.bag_version_size)), header.bag_version_size)
+                       != bag->version()) {
+            clear();
+            return false;
+        }
+        cursor.take(align8(cursor.pos - begin) - static_cast<std::size_t>(cursor.pos - begin));
+
+        // The counts come from the file: a corrupted one must not allocate, nor wrap the array sizes
+        const auto left          = static_cast<uint64_t>(cursor.end - cursor.pos);
+        const auto message_bytes = sizeof(ros::Time) + 3 * sizeof(uint32_t);
+        if (header.chunk_count > left / sizeof(SidecarChunk)
+            || header.message_count > (left - header.chunk_count * sizeof(SidecarChunk)) / message_bytes) {
+            clear();
+            return false;
+        }
+
+        _chunks.reserve(header.chunk_count);
+        for (uint64_t i = 0; i < header.chunk_count; ++i) {
+            SidecarChunk chunk;
+            std::memcpy(&chunk, cursor.take(sizeof(chunk)), sizeof(chunk));
+
+            ChunkInfo info;
+            info.start_time       = ros::Time(chunk.start_sec, chunk.start_nsec);
+            info.end_time         = ros::Time(chunk.end_sec, chunk.end_nsec);
+            info.pos              = chunk.pos;
+            info.connection_count = chunk.connection_count;
+            info.message_count    = chunk.message_count;
+            _chunks.push_back(info);
+        }
+
+        const auto*   connections = cursor.take(header.connections_size);
+        SidecarCursor connection_cursor{connections, connections + header.connections_size};
+        while (connection_cursor.pos < connection_cursor.end) {
+            const auto id          = connection_cursor.takeUInt32();
+            const auto topic       = connection_cursor.takeString();
+            const auto field_count = connection_cursor.takeUInt32();
+
+            bag_format::FieldMap fields;
+            for (uint32_t f = 0; f < field_count; ++f) {
+                auto name    = connection_cursor.takeString();
+                fields[name] = connection_cursor.takeString();
+            }
+            _connections[id] = makeConnection(id, topic, fields);
+        }
+        cursor.take(align8(cursor.pos - begin) - static_cast<std::size_t>(cursor.pos - begin));
+
+        const auto size = static_cast<std::size_t>(header.message_count);
+        _stamps         = reinterpret_cast<const ros::Time*>(cursor.take(size * sizeof(ros::Time)));
+        _connection_ids = reinterpret_cast<const uint32_t*>(cursor.take(size * sizeof(uint32_t)));
+        _chunk_ids      = reinterpret_cast<const uint32_t*>(cursor.take(size * sizeof(uint32_t)));
+        _offsets        = reinterpret_cast<const uint32_t*>(cursor.take(size * sizeof(uint32_t)));
+
+        // Every message must point to a chunk, and every chunk must hold as many messages as it says
+        std::vector<uint32_t> chunk_messages(_chunks.size(), 0);
+        for (std::size_t message = 0; message < size; ++message) {
+            if (_chunk_ids[message] >= _chunks.size()) {
+                clear();
+                return false;
+            }
+            ++chunk_messages[_chunk_ids[message]];
+        }
+        for (std::size_t chunk = 0; chunk < _chunks.size(); ++chunk) {
+            if (chunk_messages[chunk] != _chunks[chunk].message_count) {
+                clear();
+                return false;
+            }
+        }
+
+        _size           = size;
+        _file_size      = header.bag_size;
+        _index_pos      = header.index_pos;
+        _file_version   = bag->version();
+        _filename       = filename;
+
+        if (size > 0) {
+            _start_time = _stamps[0];
+            _end_time   = _stamps[size - 1];
+        }
+
+        indexConnections();
+    } catch (const std::exception&) {
+        // Whatever is wrong with it, a sidecar is only a cache: the bag is indexed again
+        clear();
+        return false;
+    }
+
+    return true;
+}
+
+void BagIndex::writeSidecar(const std::string& filename) const
+{
+    if (isBuilding())
+        throw rosbag::BagIOException("The bag index is not complete yet");
+
+    // The query of a presigned URL is neither stored nor part of the sidecar path
+    const auto location = BagSource::stripQuery(filename);
+    const auto bag      = BagSource::open(filename);
+    if (bag->size() != _file_size || bag->version() != _file_version)
+        throw rosbag::BagIOException("Bag file changed while building its index: " + location);
+    if (BagSource::isRemote(filename) && _file_version.empty())
+        throw rosbag::BagIOException("No ETag nor Last-Modified to validate a sidecar index: " + location);
+
+    // Create the cache directory and its parent, if they do not exist yet
+    const auto dir = cacheDirectory();
+    ::mkdir(dir.substr(0, dir.rfind('/')).c_str(), 0755);
+    ::mkdir(dir.c_str(), 0755);
+
+    std::ostringstream connections;
+    for (const auto& connection : _connections) {
+        const auto& info = connection.second;
+        connections.write(reinterpret_cast<const char*>(&info.id), sizeof(info.id));
+        writeString(connections, info.topic);
+
+        const auto field_count = static_cast<uint32_t>(info.header ? info.header->size() : 0);
+        connections.write(reinterpret_cast<const char*>(&field_count), sizeof(field_count));
+        if (info.header) {
+            for (const auto& field : *info.header) {
+                writeString(connections, field.first);
+                writeString(connections, field.second);
+            }
+        }
+    }
+    const auto connections_data = connections.str();
+
+    SidecarHeader header{};
+    std::memcpy(header.magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC));
+    header.version          = SIDECAR_VERSION;
+    header.path_size        = static_cast<uint32_t>(location.size());
+    header.bag_size         = _file_size;
+    header.bag_version_size = _file_version.size();
+    header.chunk_count      = _chunks.size();
+    header.connections_size = connections_data.size();
+    header.message_count    = size();
+    header.index_pos        = _index_pos;
+
+    // Write to a temporary file first, so a sidecar is either complete or missing
+    const auto    path     = sidecarPath(filename);
+    const auto    tmp_path = path + ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw rosbag::BagIOException("Error creating sidecar index: " + tmp_path);
+
+    const char padding[8] = {};
+    const auto pad        = [&out, &padding]() {
+        out.write(padding, static_cast<std::streamsize>(align8(out.tellp()) - static_cast<std::size_t>(out.tellp())));
+    };
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(location.data(), static_cast<std::streamsize>(location.size()));
+    out.write(_file_version.data(), static_cast<std::streamsize>(_file_version.size()));
+    pad();
+
+    for (const auto& info : _chunks) {
+        SidecarChunk chunk;
+        chunk.start_sec        = info.start_time.sec;
+        chunk.start_nsec       = info.start_time.nsec;
+        chunk.end_sec          = info.end_time.sec;
+        chunk.end_nsec         = info.end_time.nsec;
+        chunk.pos              = info.pos;
+        chunk.connection_count = info.connection_count;
+        chunk.message_count    = info.message_count;
+        out.write(reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+    }
+
+    out.write(connections_data.data(), static_cast<std::streamsize>(connections_data.size()));
+    pad();
+
+    const auto size = static_cast<std::streamsize>(header.message_count);
+    out.write(reinterpret_cast<const char*>(_stamps), size * static_cast<std::streamsize>(sizeof(ros::Time)));
+    out.write(reinterpret_cast<const char*>(_connection_ids), size * static_cast<std::streamsize>(sizeof(uint32_t)));
+    out.write(reinterpret_cast<const char*>(_chunk_ids), size * static_cast<std::streamsize>(sizeof(uint32_t)));
+    out.write(reinterpret_cast<const char*>(_offsets), size * static_cast<std::streamsize>(sizeof(uint32_t)));
+    out.close();
+
+    if (!out || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        throw rosbag::BagIOException("Error writing sidecar index: " + path);
+    }
+}
+
+std::string BagIndex::sidecarPath(const std::string& filename)
+{
+    std::ostringstream path;
+    path << cacheDirectory() << "/" << std::hex << std::setw(16) << std::setfill('0')
+         << std::hash<std::string>()(BagSource::stripQuery(filename)) << ".idx";
+    return path.str();
+}
+
+void BagIndex::clear(void)
+{
+    _filename.clear();
+    _file_version.clear();
+    _file_size  = 0;
+    _index_pos  = 0;
+    _start_time = ros::Time();
+    _end_time   = ros::Time();
+    _building   = false;
+    _chunks.clear();
+    _connections.clear();
+    _connection_messages.clear();
+
+    _size           = 0;
+    _stamps         = nullptr;
+    _connection_ids = nullptr;
+    _chunk_ids      = nullptr;
+    _offsets        = nullptr;
+
+    // Release the memory of the previous bag instead of keeping its capacity
+    std::vector<ros::Time>().swap(_stamp_storage);
+    std::vector<uint32_t>().swap(_connection_id_storage);
+    std::vector<uint32_t>().swap(_chunk_id_storage);
+    std::vector<uint32_t>().swap(_offset_storage);
+
+    if (_mapping != nullptr)
+        ::munmap(_mapping, _mapping_size);
+
+    _mapping      = nullptr;
+    _mapping_size = 0;
+}
+
+std::size_t BagIndex::lowerBound(const ros::Time& stamp) const
+{
+    return static_cast<std::size_t>(std::lower_bound(_stamps, _stamps + size(), stamp) - _stamps);
+}
+
+std::size_t BagIndex::upperBound(const ros::Time& stamp) const
+{
+    return static_cast<std::size_t>(std::upper_bound(_stamps, _stamps + size(), stamp) - _stamps);
+}
+
+std::size_t BagIndex::lastBefore(const uint32_t connection_id, const ros::Time& stamp) const
+{
+    const auto messages = _connection_messages.find(connection_id);
+    if (messages == _connection_messages.end())
+        return npos;
+
+    const auto& positions = messages->second;
+    const auto  next      = std::lower_bound(
+            positions.begin(),
+            positions.end(),
+            stamp,
+            [this](const uint32_t message, const ros::Time& t) { return _stamps[message] < t; });
+
+    return next == positions.begin() ? npos : *std::prev(next);
+}
+
+void BagIndex::indexConnections(void)
+{
+    _connection_messages.clear();
+    for (const auto& connection : _connections)
+        _connection_messages[connection.first];
+
+    for (std::size_t message = 0; message < size(); ++message)
+        _connection_messages[_connection_ids[message]].push_back(static_cast<uint32_t>(message));
+}
+
+void BagIndex::useStorage(void)
+{
+    _size           = _stamp_storage.size();
+    _stamps         = _stamp_storage.data();
+    _connection_ids = _connection_id_storage.data();
+    _chunk_ids      = _chunk_id_storage.data();
+    _offsets        = _offset_storage.data();
+}
+
+} // namespace rosbag_rviz_panel
@@ -0,0 +1,1583 @@
+#include "rosbag_rviz_panel/BagPlayer.h"
+
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <rosbag/bag.h>
+#include <rosgraph_msgs/Clock.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+#include "rosbag_rviz_panel/BagSource.h"
+
+#define MAX_PLAYBACK_SPEED 1000.0
+#define MIN_PLAYBACK_SPEED -1000.0
+#define RATE_WINDOW_SECONDS 0.5
+
+namespace rosbag_rviz_panel {
+
+namespace {
+
+/**
+ * @brief Raises an atomic maximum to a value, if it is larger.
+ */
+void storeMax(std::atomic<int64_t>& max, const int64_t value)
+{
+    auto current = max.load(std::memory_order_relaxed);
+    while (value > current && !max.compare_exchange_weak(current, value)) {}
+}
+
+/**
+ * @brief Returns the nanoseconds elapsed since a time point.
+ */
+uint64_t nsecSince(const std::chrono::steady_clock::time_point& start)
+{
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+} // namespace
+
+BagPlayer::BagPlayer(Listener* listener, const ros::NodeHandle& nh) :
+        _listener(listener != nullptr ? listener : &_no_listener),
+        _nh(nh),
+        _prefetcher(_bags)
+{
+    ros::Time::init();
+
+    _nh.param("ui_update_rate", _ui_update_rate, _ui_update_rate);
+    if (_ui_update_rate <= 0.0)
+        _ui_update_rate = 30.0;
+
+    int    read_ahead_messages  = 256;
+    double read_ahead_memory_mb = 64.0;
+    _nh.param("read_ahead_messages", read_ahead_messages, read_ahead_messages);
+    _nh.param("read_ahead_memory_mb", read_ahead_memory_mb, read_ahead_memory_mb);
+    _nh.param("chunk_cache_mb", _chunk_cache_mb, _chunk_cache_mb);
+
+    _nh.param("mmap_bags", _mmap_bags, _mmap_bags);
+
+    // Leaves a core to the publishing thread and one to the read-ahead thread
+    _nh.param("decode_threads", _decode_threads, _decode_threads);
+    if (_decode_threads <= 0)
+        _decode_threads = std::min(std::max(static_cast<int>(std::thread::hardware_concurrency()) - 2, 1), 8);
+    _nh.param("unthrottled_min_subscribers", _unthrottled_min_subscribers, _unthrottled_min_subscribers);
+
+    std::string seek_snapshot = "all";
+    _nh.param("seek_snapshot", seek_snapshot, seek_snapshot);
+    if (seek_snapshot == "none")
+        _seek_snapshot = SeekSnapshot::None;
+    else if (seek_snapshot == "latched")
+        _seek_snapshot = SeekSnapshot::Latched;
+    else if (seek_snapshot != "all")
+        ROS_WARN_STREAM("Unknown seek_snapshot " << seek_snapshot << ", using all");
+
+    double                   lateness_budget = 0.0;
+    std::vector<std::string> drop_topics;
+    _nh.param("lateness_budget", lateness_budget, lateness_budget);
+    _nh.param("drop_topics", drop_topics, drop_topics);
+    _lateness_budget_nsec = static_cast<int64_t>(std::max(lateness_budget, 0.0) * 1e9);
+    _drop_topics.insert(drop_topics.begin(), drop_topics.end());
+
+    int queue_size = static_cast<int>(_publisher_options.queue_size);
+    _nh.param("queue_size", queue_size, queue_size);
+    _nh.param("topic_prefix", _publisher_options.prefix, _publisher_options.prefix);
+    _publisher_options.queue_size = static_cast<uint32_t>(std::max(queue_size, 0));
+
+    _nh.param("export_compression", _export_compression, _export_compression);
+    if (_export_compression != "none" && _export_compression != "lz4" && _export_compression != "bz2") {
+        ROS_WARN_STREAM("Unknown export_compression " << _export_compression << ", using none");
+        _export_compression = "none";
+    }
+
+    _nh.param("publish_diagnostics", _publish_diagnostics, _publish_diagnostics);
+    _nh.param("diagnostics_rate", _diagnostics_rate, _diagnostics_rate);
+    if (_diagnostics_rate <= 0.0)
+        _diagnostics_rate = 1.0;
+    if (_publish_diagnostics)
+        _diagnostics_pub = ros::NodeHandle().advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+    _diagnostics_window_start = std::chrono::steady_clock::now();
+
+    _nh.param("publish_clock", _publish_clock, _publish_clock);
+    _nh.param("clock_rate", _clock_rate, _clock_rate);
+    if (_clock_rate <= 0.0)
+        _clock_rate = 100.0;
+    if (_publish_clock)
+        _clock_pub = ros::NodeHandle().advertise<rosgraph_msgs::Clock>("/clock", 1);
+
+    _prefetcher.setCapacity(
+            static_cast<std::size_t>(std::max(read_ahead_messages, 1)),
+            static_cast<std::size_t>(std::max(read_ahead_memory_mb, 0.0) * 1024 * 1024));
+    _prefetcher.setDecodeThreads(static_cast<std::size_t>(_decode_threads));
+    _prefetcher.setMemoryMapped(_mmap_bags);
+    _chunk_cache_mb = std::max(_chunk_cache_mb, 0.0);
+    _prefetcher.setCacheCapacity(static_cast<std::size_t>(_chunk_cache_mb * 1024 * 1024));
+
+    _play_thread = std::thread(&BagPlayer::work, this);
+}
+
+BagPlayer::~BagPlayer()
+{
+    {
+        std::lock_guard<std::mutex> lock(_command_mutex);
+        _quit = true;
+        ++_command_id;
+    }
+    _command_cv.notify_all();
+    _prefetcher.wake();
+
+    if (_play_thread.joinable())
+        _play_thread.join();
+
+    cancelExport();
+    cancelLoad();
+
+    _prefetcher.close();
+}
+
+bool BagPlayer::load(const std::vector<std::string>& filenames)
+{
+    stopPlayback(true);
+    cancelExport();
+    cancelLoad();
+    resetTxt();
+
+    _connection_pubs.clear();
+    if (!_pubs.empty())
+        _pubs.clear();
+
+    _prefetcher.close();
+    _bags.clear();
+
+    try {
+        for (const auto& filename : filenames) {
+            const std::string loading_msg = "Loading " + BagSource::stripQuery(filename) + "...";
+            ROS_INFO_STREAM(loading_msg);
+            _listener->onStatusText(loading_msg);
+
+            // Reuse the index from a previous load of the same bag, if it is still up to date
+            if (_bags.add(filename))
+                ROS_DEBUG_STREAM("Using the sidecar index " << BagIndex::sidecarPath(filename));
+        }
+
+        _prefetcher.open();
+    } catch (const rosbag::BagException& r) {
+        _prefetcher.close();
+        _bags.clear();
+        ROS_ERROR_STREAM(r.what());
+        _listener->onStatusText(r.what());
+        _listener->onEnableActionButtons(false);
+        return false;
+    }
+
+    _full_bag_start = _bags.startTime();
+    _full_bag_end   = _bags.endTime();
+
+    // The A/B range of the previous bags is cleared, the controls are rewound to the whole bag
+    _last_message_nsec = 0;
+    _played            = false;
+    _playback.update([this](PlaybackState& state) {
+        state.speed       = 1.0;
+        state.range_start = _full_bag_start;
+        state.range_end   = _full_bag_end;
+    });
+    reset();
+
+    _listener->onBagFinished();
+
+    _selected_topics.clear();
+    for (const auto& connection : _bags.connections()) {
+        if (connection.info != nullptr)
+            _selected_topics.insert(connection.info->topic);
+    }
+    const std::vector<std::string> topics(_selected_topics.begin(), _selected_topics.end());
+
+    // Only resized while the play thread is stopped, the totals of the previous bags are dropped
+    _connection_statistics = std::vector<ConnectionStatistics>(_bags.connections().size());
+    _diagnostics_window_connection_messages.assign(_bags.connections().size(), 0);
+    _diagnostics_window_connection_bytes.assign(_bags.connections().size(), 0);
+
+    advertiseSelectedTopics();
+    _listener->onTopics(topics);
+    _density_topic.clear();
+    _density_outdated = true;
+
+    _listener->onStatusText("");
+    _listener->onEnableActionButtons(true);
+
+    // Forward playback is already possible, the messages are indexed in the background
+    if (_bags.isBuilding()) {
+        _listener->onEnableSeekControls(false);
+        _load_thread = std::thread(&BagPlayer::buildIndexes, this);
+    }
+
+    sizeToStr(_bags.fileSize());
+    publishPlaybackSpeed();
+
+    _playhead_nsec              = _full_bag_start.toNSec();
+    _published_playhead_nsec    = 0;
+    _rate_window_start          = std::chrono::steady_clock::now();
+    _rate_window_messages       = _published_messages;
+    _rate_window_bytes          = _published_bytes;
+    _rate_window_publish_nsec   = _publish_nsec;
+    _rate_window_chunks         = _prefetcher.statistics();
+    _message_rate               = 0.0;
+    _byte_rate                  = 0.0;
+    _read_rate                  = 0.0;
+    _read_load                  = 0.0;
+    _decode_load                = 0.0;
+    _publish_load               = 0.0;
+    _dropped_messages           = 0;
+    _published_dropped_messages = 0;
+    for (auto& bin : _lateness_histogram)
+        bin = 0;
+    _loaded = true;
+    publishPlayheadState();
+    return true;
+}
+
+void BagPlayer::setStart(const ros::Time& start)
+{
+    _playback.update([&start](PlaybackState& state) {
+        if (state.speed > 0) {
+            state.control_start = start;
+
+            if (state.direction_changed)
+                state.control_end = state.range_end;
+        } else {
+            state.control_end = start;
+
+            if (state.direction_changed)
+                state.control_start = state.range_start;
+        }
+    });
+
+    _last_message_nsec = start.toNSec();
+    _played            = true;
+    requestRestart();
+}
+
+void BagPlayer::setEnd(const ros::Time& end)
+{
+    _playback.update([&end](PlaybackState& state) {
+        if (state.speed > 0) {
+            state.control_end = end;
+
+            if (state.direction_changed)
+                state.control_start = state.range_start;
+        } else {
+            state.control_start = end;
+
+            if (state.direction_changed)
+                state.control_end = state.range_end;
+        }
+    });
+
+    _last_message_nsec = end.toNSec();
+    _played            = true;
+    requestRestart();
+}
+
+void BagPlayer::changeSpeed(const float change)
+{
+    // Crossing zero flips the playback direction, keeping the speed step
+    auto speed = _playback.load().speed + change;
+    if (speed == 0.0)
+        speed = change;
+
+    setSpeed(speed);
+}
+
+void BagPlayer::setSpeed(const double speed)
+{
+    if (speed == 0.0) {
+        publishPlaybackSpeed();
+        return;
+    }
+
+    const auto new_speed = std::min(std::max(speed, MIN_PLAYBACK_SPEED), MAX_PLAYBACK_SPEED);
+
+    // In the same direction the playback goes on from the simulated time, keeping the read-ahead
+    if ((new_speed > 0.0) == (_playback.load().speed > 0.0)) {
+        _playback.update([this, new_speed](PlaybackState& state) {
+            reanchorClock(state);
+            state.speed = new_speed;
+        });
+
+        publishPlaybackSpeed();
+        interruptWait();
+        return;
+    }
+
+    // The other direction is read again from the playhead
+    const bool playing = isPlaying();
+    stopPlayback(true);
+
+    _playback.update([new_speed](PlaybackState& state) {
+        state.direction_changed = true;
+        state.speed             = new_speed;
+    });
+
+    publishPlaybackSpeed();
+
+    // Before anything is played, the whole range is played in the new direction
+    if (_played) {
+        setStart(lastMessageTime());
+    } else {
+        reset();
+        requestRestart();
+    }
+
+    if (playing)
+        play();
+}
+
+void BagPlayer::setUnthrottled(const bool enable)
+{
+    // The throttled clock goes on from the playhead, not counting the unthrottled messages
+    _playback.update([this, enable](PlaybackState& state) {
+        reanchorClock(state);
+        state.unthrottled = enable;
+    });
+
+    publishPlaybackSpeed();
+    interruptWait();
+}
+
+void BagPlayer::pause(void)
+{
+    stopPlayback(false);
+}
+
+void BagPlayer::play(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_command_mutex);
+        if (_play_requested) {
+            ROS_DEBUG_STREAM("BagPlayer is already running!");
+            return;
+        }
+
+        _play_requested = true;
+        ++_command_id;
+    }
+
+    _command_cv.notify_all();
+}
+
+void BagPlayer::gotoBegin(void)
+{
+    // Paused, the held message and the read-ahead are dropped as well, so the next play starts from here
+    const bool playing = isPlaying();
+    stopPlayback(true);
+    if (playing)
+        _listener->onBagFinished();
+
+    reset();
+
+    // As if nothing was played, so the first step forward publishes the first messages, even at time 0
+    const auto start   = _playback.load().range_start;
+    _last_message_nsec = start.toNSec();
+    _played            = false;
+    _playhead_nsec     = start.toNSec();
+    publishPlayheadState();
+}
+
+void BagPlayer::gotoEnd(void)
+{
+    // Paused, the held message and the read-ahead are dropped as well, so the next play starts from here
+    const bool playing = isPlaying();
+    stopPlayback(true);
+    if (playing)
+        _listener->onBagFinished();
+
+    reset();
+
+    const auto end     = _playback.load().range_end;
+    _last_message_nsec = end.toNSec();
+    _played            = true;
+    _playhead_nsec     = end.toNSec();
+    publishPlayheadState();
+}
+
+void BagPlayer::selectTopics(const std::vector<std::string>& topics)
+{
+    // The play loop reads the publishers, so they only change while it is stopped
+    const bool playing = isPlaying();
+    stopPlayback(true);
+
+    _selected_topics.clear();
+    _selected_topics.insert(topics.begin(), topics.end());
+
+    advertiseSelectedTopics();
+    _density_outdated = true;
+
+    // The read-ahead only holds the previous topics, so it is read again from the playhead
+    if (_played)
+        setStart(lastMessageTime());
+
+    if (playing)
+        play();
+}
+
+void BagPlayer::setDensityTopic(const std::string& topic)
+{
+    _density_topic    = topic;
+    _density_outdated = true;
+}
+
+void BagPlayer::setPublisherOptions(const PublisherOptions& options)
+{
+    // The play loop reads the publishers, so they only change while it is stopped
+    const bool playing = isPlaying();
+    stopPlayback(true);
+
+    // Every topic is advertised again, with its new queue size and name
+    _publisher_options = options;
+    _pubs.clear();
+    advertiseSelectedTopics();
+
+    if (_played)
+        setStart(lastMessageTime());
+
+    if (playing)
+        play();
+}
+
+void BagPlayer::setChunkCacheSize(const double megabytes)
+{
+    // The cache is only used by the read-ahead thread, which is stopped meanwhile
+    const bool playing = isPlaying();
+    stopPlayback(true);
+    _prefetcher.stop();
+
+    _chunk_cache_mb = std::max(megabytes, 0.0);
+    _prefetcher.setCacheCapacity(static_cast<std::size_t>(_chunk_cache_mb * 1024 * 1024));
+
+    if (_played)
+        setStart(lastMessageTime());
+
+    if (playing)
+        play();
+}
+
+void BagPlayer::seek(const ros::Time& stamp)
+{
+    if (_bags.empty())
+        return;
+
+    if (_bags.isBuilding()) {
+        ROS_WARN_STREAM("Seeking is not available until the bag is indexed");
+        return;
+    }
+
+    // The snapshot reads the bags on this thread, so the read-ahead thread is stopped as well
+    const bool playing = isPlaying();
+    stopPlayback(true);
+    _prefetcher.stop();
+
+    // Inside the A/B range
+    const auto state = _playback.load();
+    const auto start = std::min(std::max(stamp, state.range_start), state.range_end);
+    setStart(start);
+    publishSnapshot(start);
+
+    if (playing)
+        play();
+}
+
+void BagPlayer::seekProgress(const double progress)
+{
+    seek(getProgressTime(progress));
+}
+
+void BagPlayer::step(const std::string& topic, const int count)
+{
+    if (count == 0 || _bags.empty())
+        return;
+
+    if (_bags.isBuilding()) {
+        ROS_WARN_STREAM("Stepping is not available until the bag is indexed");
+        return;
+    }
+
+    // The read-ahead is used to publish the step, the playback reads again from there on the next play
+    stopPlayback(true);
+
+    // Before anything is played, the first step goes to the first or the last message of the topic in the range
+    const ros::Duration nsec(0, 1);
+    const bool          played = _played;
+    const auto          state  = _playback.load();
+    const auto          from   = played ? lastMessageTime() : (count > 0 ? state.range_start : state.range_end);
+
+    ros::Time target;
+    if (!findStep(topic, from, count, !played, target)) {
+        ROS_WARN_STREAM("No message of " << topic << " to step to");
+        return;
+    }
+
+    // Forward, the messages of the other topics up to the target are published too
+    _prefetcher.start(count > 0 && played ? from + nsec : (count > 0 ? from : target), target, true);
+    while (const auto* message = _prefetcher.front()) {
+        publishMessage(*message);
+        _prefetcher.pop();
+    }
+    _prefetcher.stop();
+
+    const auto error = _prefetcher.error();
+    if (!error.empty()) {
+        ROS_ERROR_STREAM(error);
+        _listener->onStatusText(error);
+    }
+
+    if (_publish_clock) {
+        rosgraph_msgs::Clock msg;
+        _clock_time = target;
+        msg.clock   = _clock_time;
+        _clock_pub.publish(msg);
+    }
+
+    // The playback resumes right after the target, in its direction, not below time 0
+    const auto target_nsec = target.toNSec();
+    ros::Time  resume;
+    resume.fromNSec(_playback.load().speed > 0 ? target_nsec + 1 : (target_nsec > 0 ? target_nsec - 1 : 0));
+    setStart(resume);
+    _last_message_nsec = target.toNSec();
+    _playhead_nsec     = target.toNSec();
+    publishPlayheadState();
+}
+
+void BagPlayer::setRangeStart(const bool enable)
+{
+    ros::Time playhead;
+    playhead.fromNSec(_playhead_nsec.load(std::memory_order_relaxed));
+
+    // A start after the end moves the end back to the end of the bag
+    const auto state = _playback.load();
+    const auto start = enable ? playhead : _full_bag_start;
+    setRange(start, start <= state.range_end ? state.range_end : _full_bag_end);
+}
+
+void BagPlayer::setRangeEnd(const bool enable)
+{
+    ros::Time playhead;
+    playhead.fromNSec(_playhead_nsec.load(std::memory_order_relaxed));
+
+    const auto state = _playback.load();
+    const auto end   = enable ? playhead : _full_bag_end;
+    setRange(end >= state.range_start ? state.range_start : _full_bag_start, end);
+}
+
+bool BagPlayer::exportRange(const std::string& filename)
+{
+    if (_bags.empty()) {
+        ROS_WARN_STREAM("There is no bag to export");
+        _listener->onStatusText("There is no bag to export");
+        return false;
+    }
+
+    if (_exporting) {
+        ROS_WARN_STREAM("An export is already running");
+        _listener->onStatusText("An export is already running");
+        return false;
+    }
+
+    if (_export_thread.joinable())
+        _export_thread.join();
+
+    // The selected topics at the time of the export, even those that could not be advertised
+    const auto&       connections = _bags.connections();
+    std::vector<bool> filter(connections.size(), false);
+    for (uint32_t id = 0; id < connections.size(); ++id)
+        filter[id] = connections[id].info != nullptr && _selected_topics.count(connections[id].info->topic) > 0;
+
+    _exporter = std::make_unique<MessagePrefetcher>(_bags);
+    _exporter->setConnectionFilter(std::move(filter));
+    _exporter->setDecodeThreads(static_cast<std::size_t>(_decode_threads));
+    _exporter->setMemoryMapped(_mmap_bags);
+    try {
+        _exporter->open();
+    } catch (const rosbag::BagException& e) {
+        _exporter.reset();
+        const std::string error = "Could not export " + filename + ": " + e.what();
+        ROS_ERROR_STREAM(error);
+        _listener->onStatusText(error);
+        return false;
+    }
+
+    const auto state = _playback.load();
+    _cancel_export   = false;
+    _exporting       = true;
+    _listener->onExportProgress(0);
+    _export_thread = std::thread(&BagPlayer::exportMessages, this, filename, state.range_start, state.range_end);
+    return true;
+}
+
+void BagPlayer::setLoop(const bool enable)
+{
+    _playback.update([enable](PlaybackState& state) { state.loop = enable; });
+    publishPlayheadState();
+}
+
+void BagPlayer::setRange(const ros::Time& range_start, const ros::Time& range_end)
+{
+    const auto start = std::max(range_start, _full_bag_start);
+    const auto end   = std::min(range_end, _full_bag_end);
+    if (_bags.empty() || start > end)
+        return;
+
+    ros::Time playhead;
+    playhead.fromNSec(_playhead_nsec.load(std::memory_order_relaxed));
+    playhead = std::min(std::max(playhead, start), end);
+
+    // The current playback goes on from the playhead, bounded by the new range
+    _playback.update([&start, &end, &playhead](PlaybackState& state) {
+        state.range_start   = start;
+        state.range_end     = end;
+        state.control_start = state.speed > 0 ? playhead : start;
+        state.control_end   = state.speed > 0 ? end : playhead;
+    });
+
+    _last_message_nsec = playhead.toNSec();
+    _played            = true;
+    requestRestart();
+    publishPlayheadState();
+}
+
+bool BagPlayer::isPlaying(void)
+{
+    std::lock_guard<std::mutex> lock(_command_mutex);
+    return _play_requested;
+}
+
+void BagPlayer::stopPlayback(const bool restart)
+{
+    std::unique_lock<std::mutex> lock(_command_mutex);
+    _play_requested = false;
+    _restart        = _restart || restart;
+    ++_command_id;
+    _command_cv.notify_all();
+
+    // Wakes the play loop if it is waiting for the read-ahead
+    _prefetcher.wake();
+
+    _idle_cv.wait(lock, [this]() { return _idle; });
+}
+
+void BagPlayer::requestRestart(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_command_mutex);
+        _restart = true;
+        ++_command_id;
+    }
+
+    _command_cv.notify_all();
+    _prefetcher.wake();
+}
+
+void BagPlayer::interruptWait(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_command_mutex);
+        ++_command_id;
+    }
+
+    _command_cv.notify_all();
+}
+
+bool BagPlayer::isInterrupted(void) const
+{
+    return _quit || !_play_requested || _restart;
+}
+
+ros::Time BagPlayer::lastMessageTime(void) const
+{
+    ros::Time stamp;
+    return stamp.fromNSec(_last_message_nsec.load(std::memory_order_relaxed));
+}
+
+bool BagPlayer::findStep(
+        const std::string& topic,
+        const ros::Time&   from,
+        const int          count,
+        const bool         inclusive,
+        ros::Time&         target) const
+{
+    const auto&       connections = _bags.connections();
+    std::vector<bool> anchors(connections.size(), false);
+    for (std::size_t id = 0; id < connections.size(); ++id)
+        anchors[id] = connections[id].info != nullptr && connections[id].info->topic == topic;
+
+    // One message of the topic at a time, the closest one over all the bags
+    target = from;
+    for (int step = 0; step < std::abs(count); ++step) {
+        const auto current = target;
+        const bool include = inclusive && step == 0;
+        bool       found   = false;
+        for (std::size_t bag = 0; bag < _bags.size(); ++bag) {
+            const auto& index = _bags.index(bag);
+            const auto  base  = _bags.connectionBase(bag);
+
+            if (count > 0) {
+                const auto first = include ? index.lowerBound(current) : index.upperBound(current);
+                for (auto message = first; message < index.size(); ++message) {
+                    if (anchors[base + index.connectionId(message)]) {
+                        if (!found || index.stamp(message) < target)
+                            target = index.stamp(message);
+                        found = true;
+                        break;
+                    }
+                }
+            } else {
+                const auto last = include ? index.upperBound(current) : index.lowerBound(current);
+                for (auto message = last; message-- > 0;) {
+                    if (anchors[base + index.connectionId(message)]) {
+                        if (!found || index.stamp(message) > target)
+                            target = index.stamp(message);
+                        found = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (!found)
+            return step > 0;
+    }
+
+    return true;
+}
+
+void BagPlayer::work(void)
+{
+    for (;;) {
+        bool restart;
+        {
+            std::unique_lock<std::mutex> lock(_command_mutex);
+            _idle = true;
+            _idle_cv.notify_all();
+
+            _command_cv.wait(lock, [this]() { return _quit || _play_requested; });
+            if (_quit)
+                break;
+
+            _idle    = false;
+            restart  = _restart;
+            _restart = false;
+        }
+
+        playBag(restart);
+    }
+
+    _prefetcher.stop();
+}
+
+void BagPlayer::playBag(const bool restart)
+{
+    if (restart && !startReading()) {
+        finishPlayback();
+        return;
+    }
+
+    // A pass of a loop without any message to play ends the loop
+    bool published = !restart;
+
+    for (;;) {
+        if (_held_message == nullptr) {
+            _held_message = _prefetcher.front();
+
+            if (_held_message == nullptr) {
+                if (isInterrupted())
+                    break;
+
+                // Woken up by a command that does not stop the playback
+                if (!_prefetcher.done())
+                    continue;
+
+                // A loop reads the range again from the indexes and the chunk cache, on the same thread
+                if (published && _playback.load().loop && _prefetcher.error().empty()) {
+                    stopClock();
+                    reset();
+                    published = false;
+                    if (startReading())
+                        continue;
+                }
+
+                finishPlayback();
+                break;
+            }
+        }
+
+        // The clock starts with the first message read, not counting the first chunk load as lateness
+        startClock(_held_message->stamp);
+
+        int64_t lateness_nsec = 0;
+        if (!waitForMessage(*_held_message, lateness_nsec))
+            break;
+
+        // Dropping the messages late over the budget catches up with the clock instead of drifting
+        if (lateness_nsec > _lateness_budget_nsec && isDroppable(*_held_message))
+            _dropped_messages.fetch_add(1, std::memory_order_relaxed);
+        else
+            publishMessage(*_held_message);
+        published = true;
+        _prefetcher.pop();
+        _held_message = nullptr;
+    }
+
+    stopClock();
+}
+
+bool BagPlayer::startReading(void)
+{
+    _prefetcher.stop();
+    _held_message = nullptr;
+
+    const auto state = _playback.load();
+    if (state.speed < 0 && _bags.isBuilding()) {
+        ROS_WARN_STREAM("Reverse playback is not available until the bag is indexed");
+        return false;
+    }
+
+    _prefetcher.start(state.control_start, state.control_end, state.speed > 0);
+
+    // Restarting from an earlier stamp is the only case where the clock goes back
+    const auto anchor = state.speed > 0 ? state.control_start : state.control_end;
+    _playback.update([&anchor](PlaybackState& playback) { playback.anchor = anchor; });
+    _clock_time = anchor;
+    return true;
+}
+
+void BagPlayer::finishPlayback(void)
+{
+    _prefetcher.stop();
+    _held_message = nullptr;
+
+    const auto error = _prefetcher.error();
+    if (!error.empty()) {
+        ROS_ERROR_STREAM(error);
+        _listener->onStatusText(error);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_command_mutex);
+        _play_requested = false;
+        _restart        = true;
+    }
+
+    reset();
+    _listener->onBagFinished();
+}
+
+void BagPlayer::buildIndexes(void)
+{
+    std::vector<std::size_t> building;
+    for (std::size_t bag = 0; bag < _bags.size(); ++bag) {
+        if (_bags.index(bag).isBuilding())
+            building.push_back(bag);
+    }
+
+    int last_percent = -1;
+    for (std::size_t i = 0; i < building.size(); ++i) {
+        auto&             index        = _bags.index(building[i]);
+        const auto&       filename     = _bags.filename(building[i]);
+        const auto        location     = BagSource::stripQuery(filename);
+        const std::string indexing_msg = "Indexing " + location + "... ";
+
+        try {
+            // The progress goes over all the bags to index
+            const auto report = [this, &indexing_msg, &last_percent, &building, i](const float progress) {
+                const int percent = static_cast<int>((i + progress) / building.size() * 100);
+                if (percent != last_percent) {
+                    last_percent = percent;
+                    _listener->onStatusText(indexing_msg + std::to_string(percent) + "%");
+                    _listener->onLoadProgress(percent);
+                }
+                return !_cancel_load;
+            };
+
+            if (!index.build(report)) {
+                ROS_DEBUG_STREAM("Indexing of " << location << " cancelled");
+                stopBuilding(building, i + 1);
+                return;
+            }
+        } catch (const rosbag::BagException& e) {
+            const std::string error = "Could not index " + location + ": " + e.what();
+            ROS_ERROR_STREAM(error);
+            _listener->onStatusText(error);
+            _listener->onLoadProgress(0);
+            stopBuilding(building, i + 1);
+            return;
+        }
+
+        try {
+            index.writeSidecar(filename);
+        } catch (const rosbag::BagException& e) {
+            ROS_WARN_STREAM("Could not write the sidecar index: " << e.what());
+        }
+    }
+
+    _listener->onStatusText("");
+    _listener->onLoadProgress(0);
+    _listener->onEnableSeekControls(true);
+}
+
+void BagPlayer::stopBuilding(const std::vector<std::size_t>& building, const std::size_t first)
+{
+    // The bags left are played with the messages indexed so far, nothing waits for them anymore
+    for (std::size_t i = first; i < building.size(); ++i)
+        _bags.index(building[i]).stopBuilding();
+}
+
+void BagPlayer::cancelLoad(void)
+{
+    _cancel_load = true;
+
+    if (_load_thread.joinable())
+        _load_thread.join();
+
+    _cancel_load = false;
+}
+
+void BagPlayer::exportMessages(const std::string filename, const ros::Time start, const ros::Time end)
+{
+    const std::string exporting_msg = "Exporting " + filename + "...";
+    ROS_INFO_STREAM(exporting_msg);
+    _listener->onStatusText(exporting_msg);
+
+    std::string error;
+    uint64_t    exported = 0;
+    try {
+        rosbag::Bag bag(filename, rosbag::bagmode::Write);
+        if (_export_compression == "lz4")
+            bag.setCompression(rosbag::compression::LZ4);
+        else if (_export_compression == "bz2")
+            bag.setCompression(rosbag::compression::BZ2);
+
+        const auto& connections = _bags.connections();
+        const auto  duration    = (end - start).toSec();
+        int         progress    = 0;
+
+        // A cancel may come before the read starts, which clears the interruption
+        _exporter->start(start, end, true);
+        while (!_cancel_export) {
+            const auto* message = _exporter->front();
+            if (message == nullptr)
+                break;
+
+            // Written as they are stored, with the header of their connection
+            const auto* connection = connections[message->connection_id].info;
+            bag.write(connection->topic, message->stamp, RawMessage{connection, message->data}, connection->header);
+            ++exported;
+
+            // 100 is sent once the bag is closed
+            const auto elapsed = (message->stamp - start).toSec();
+            const int  current = duration > 0.0 ? static_cast<int>(elapsed / duration * 100) : 0;
+            if (current > progress) {
+                progress = current;
+                _listener->onExportProgress(std::min(progress, 99));
+            }
+            _exporter->pop();
+        }
+
+        error = _exporter->error();
+        if (error.empty() && _cancel_export)
+            error = "Export cancelled";
+        bag.close();
+    } catch (const rosbag::BagException& e) {
+        error = e.what();
+    }
+
+    _exporter->stop();
+    if (!error.empty()) {
+        std::remove(filename.c_str());
+        ROS_ERROR_STREAM("Error exporting " << filename << ": " << error);
+        _listener->onStatusText("Error exporting " + filename + ": " + error);
+    } else {
+        ROS_INFO_STREAM("Exported " << exported << " messages to " << filename);
+        _listener->onStatusText("Exported " + std::to_string(exported) + " messages to " + filename);
+    }
+
+    _exporting = false;
+    _listener->onExportProgress(100);
+}
+
+void BagPlayer::cancelExport(void)
+{
+    _cancel_export = true;
+    if (_exporter != nullptr)
+        _exporter->interrupt();
+
+    if (_export_thread.joinable())
+        _export_thread.join();
+
+    _exporter.reset();
+    _exporting = false;
+}
+
+const BagPlayer::ConnectionPublisher* BagPlayer::connectionPublisher(const uint32_t connection_id) const
+{
+    if (connection_id >= _connection_pubs.size() || _connection_pubs[connection_id].publisher == nullptr)
+        return nullptr;
+
+    return &_connection_pubs[connection_id];
+}
+
+bool BagPlayer::isDroppable(const PrefetchedMessage& message) const
+{
+    const auto* pub = connectionPublisher(message.connection_id);
+    return _lateness_budget_nsec > 0 && pub != nullptr && pub->droppable;
+}
+
+bool BagPlayer::waitForMessage(const PrefetchedMessage& message, int64_t& lateness_nsec)
+{
+    lateness_nsec = 0;
+
+    const auto* pub = connectionPublisher(message.connection_id);
+    if (pub == nullptr)
+        return true;
+
+    _next_stamp_nsec.store(message.stamp.toNSec(), std::memory_order_relaxed);
+
+    for (;;) {
+        if (isInterrupted())
+            return false;
+
+        // Any command wakes the wait up, and a speed change moves the deadline
+        const auto command_id  = _command_id.load();
+        const auto interrupted = [this, command_id]() { return _command_id != command_id; };
+        const auto state       = _playback.load();
+
+        if (state.unthrottled) {
+            if (static_cast<int>(pub->publisher->getNumSubscribers()) >= _unthrottled_min_subscribers)
+                return true;
+
+            std::unique_lock<std::mutex> lock(_command_mutex);
+            _command_cv.wait_for(lock, std::chrono::milliseconds(10), interrupted);
+            continue;
+        }
+
+        // Messages already due are published without locking
+        const auto deadline = real_time(state, message.stamp);
+        if (std::chrono::steady_clock::now() < deadline) {
+            std::unique_lock<std::mutex> lock(_command_mutex);
+            if (_command_cv.wait_until(lock, deadline, interrupted))
+                continue;
+        }
+
+        const auto late = std::chrono::steady_clock::now() - deadline;
+        lateness_nsec   = std::chrono::duration_cast<std::chrono::nanoseconds>(late).count();
+        recordLateness(lateness_nsec);
+        return true;
+    }
+}
+
+void BagPlayer::recordLateness(const int64_t lateness_nsec)
+{
+    storeMax(_max_lateness_nsec, lateness_nsec);
+    storeMax(_diagnostics_max_lateness_nsec, lateness_nsec);
+
+    const auto& limits = LATENESS_BIN_LIMITS_MS;
+    const auto  bin    = std::upper_bound(limits.begin(), limits.end(), lateness_nsec * 1e-6) - limits.begin();
+    _lateness_histogram[bin].fetch_add(1, std::memory_order_relaxed);
+}
+
+bool BagPlayer::publishData(const uint32_t connection_id, const MessageData& data)
+{
+    const auto* pub = connectionPublisher(connection_id);
+    if (pub == nullptr)
+        return false;
+
+    // Published straight from the chunk buffer, see RawMessage
+    const auto start = std::chrono::steady_clock::now();
+    pub->publisher->publish(RawMessage{pub->connection, data});
+    _publish_nsec.fetch_add(nsecSince(start), std::memory_order_relaxed);
+
+    _published_messages.fetch_add(1, std::memory_order_relaxed);
+    _published_bytes.fetch_add(data.size, std::memory_order_relaxed);
+    _connection_statistics[connection_id].messages.fetch_add(1, std::memory_order_relaxed);
+    _connection_statistics[connection_id].bytes.fetch_add(data.size, std::memory_order_relaxed);
+    return true;
+}
+
+void BagPlayer::publishMessage(const PrefetchedMessage& message)
+{
+    if (!publishData(message.connection_id, message.data))
+        return;
+
+    _last_message_nsec.store(message.stamp.toNSec(), std::memory_order_relaxed);
+    _played.store(true, std::memory_order_relaxed);
+    _playhead_nsec.store(message.stamp.toNSec(), std::memory_order_relaxed);
+}
+
+void BagPlayer::publishSnapshot(const ros::Time& stamp)
+{
+    if (_seek_snapshot == SeekSnapshot::None)
+        return;
+
+    std::vector<PrefetchedMessage> snapshot;
+    for (std::size_t bag = 0; bag < _bags.size(); ++bag) {
+        const auto& index = _bags.index(bag);
+        for (const auto& connection : index.connections()) {
+            const auto  connection_id = _bags.connectionBase(bag) + connection.first;
+            const auto* pub           = connectionPublisher(connection_id);
+            if (pub == nullptr || (_seek_snapshot == SeekSnapshot::Latched && !isLatching(pub->connection)))
+                continue;
+
+            const auto message = index.lastBefore(connection.first, stamp);
+            if (message == BagIndex::npos)
+                continue;
+
+            PrefetchedMessage last;
+            last.bag           = bag;
+            last.message       = message;
+            last.stamp         = index.stamp(message);
+            last.connection_id = connection_id;
+            snapshot.push_back(std::move(last));
+        }
+    }
+
+    // The latest message is published last, e.g. when several nodes published on the same topic
+    std::stable_sort(snapshot.begin(), snapshot.end(), [](const PrefetchedMessage& a, const PrefetchedMessage& b) {
+        return a.stamp < b.stamp;
+    });
+
+    try {
+        for (auto& message : snapshot) {
+            message.data = _prefetcher.readMessage(message.bag, message.message);
+            publishData(message.connection_id, message.data);
+            message.data = MessageData();
+        }
+    } catch (const rosbag::BagException& e) {
+        ROS_ERROR_STREAM(e.what());
+        _listener->onStatusText(e.what());
+    }
+}
+
+void BagPlayer::startClock(const ros::Time& next_stamp)
+{
+    // Only the play thread starts the clock, so it is checked without locking
+    if (_playback.load().running)
+        return;
+
+    _playback.update([](PlaybackState& state) {
+        state.play_start = std::chrono::steady_clock::now();
+        state.running    = true;
+    });
+
+    if (_publish_clock && _playback.load().speed > 0) {
+        _next_stamp_nsec = next_stamp.toNSec();
+        _clock_running   = true;
+        _clock_thread    = std::thread(&BagPlayer::publishClock, this);
+    }
+}
+
+void BagPlayer::stopClock(void)
+{
+    _playback.update([this](PlaybackState& state) {
+        if (state.running) {
+            reanchorClock(state);
+            state.running = false;
+        }
+    });
+
+    _clock_running = false;
+    if (_clock_thread.joinable())
+        _clock_thread.join();
+}
+
+void BagPlayer::advertiseSelectedTopics(void)
+{
+    for (auto pub = _pubs.begin(); pub != _pubs.end();) {
+        if (_selected_topics.count(pub->first) == 0)
+            pub = _pubs.erase(pub);
+        else
+            ++pub;
+    }
+
+    // Indexed by set-wide connection id, the bags publishing the same topic share its publisher
+    const auto& connections = _bags.connections();
+    _connection_pubs.assign(connections.size(), ConnectionPublisher());
+    std::vector<bool> filter(connections.size(), false);
+
+    for (uint32_t id = 0; id < connections.size(); ++id) {
+        const auto* info = connections[id].info;
+        if (info == nullptr || _selected_topics.count(info->topic) == 0)
+            continue;
+
+        auto pub = _pubs.find(info->topic);
+        if (pub == _pubs.end()) {
+            try {
+                const auto            queue_size = queueSize(info->topic);
+                ros::AdvertiseOptions opts       = createAdvertiseOptions(info, queue_size, _publisher_options.prefix);
+                pub                              = _pubs.emplace(info->topic, _nh.advertise(opts)).first;
+
+            } catch (const std::runtime_error& e) {
+                ROS_ERROR_STREAM(e.what());
+                _listener->onStatusText(e.what());
+                continue;
+            }
+        }
+
+        const bool droppable = _drop_topics.empty() || _drop_topics.count(info->topic) > 0;
+        _connection_pubs[id] = ConnectionPublisher{&pub->second, info, droppable};
+        filter[id]           = true;
+    }
+
+    // Messages without a publisher are skipped before their chunk is read
+    _prefetcher.setConnectionFilter(std::move(filter));
+}
+
+uint32_t BagPlayer::queueSize(const std::string& topic) const
+{
+    const auto queue_size = _publisher_options.queue_sizes.find(topic);
+    return queue_size != _publisher_options.queue_sizes.end() ? queue_size->second : _publisher_options.queue_size;
+}
+
+ros::AdvertiseOptions BagPlayer::createAdvertiseOptions(
+        const rosbag::ConnectionInfo* c,
+        uint32_t                      queue_size,
+        const std::string&            prefix)
+{
+    ros::AdvertiseOptions opts(prefix + c->topic, queue_size, c->md5sum, c->datatype, c->msg_def);
+    opts.latch = isLatching(c);
+    return opts;
+}
+
+bool BagPlayer::isLatching(const rosbag::ConnectionInfo* c)
+{
+    ros::M_string::const_iterator header_iter = c->header->find("latching");
+    return (header_iter != c->header->end() && header_iter->second == "1");
+}
+
+void BagPlayer::sizeToStr(const uint64_t size)
+{
+    const std::array<const char*, 9> size_name = {"B", "KB", "MB", "GB", "TB", "PB", "EB", "ZB", "YB"};
+    const int                        i         = static_cast<int>(std::floor(std::log(size) / std::log(1024)));
+    const double                     p         = std::pow(1024, i);
+    const double                     s         = round(size / p * 100) / 100;
+    if (s > 0) {
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(2) << s << " " << size_name[i];
+        _listener->onBagSize(text.str());
+        return;
+    }
+
+    _listener->onBagSize("0 B");
+}
+
+void BagPlayer::reset(void)
+{
+    _playback.update([](PlaybackState& state) {
+        state.control_start     = state.range_start;
+        state.control_end       = state.range_end;
+        state.direction_changed = false;
+    });
+}
+
+void BagPlayer::resetTxt(void)
+{
+    _loaded = false;
+
+    _listener->onPlayheadState(PlayheadState());
+    _listener->onPlaybackSpeed(0.0, _playback.load().unthrottled);
+    _listener->onTopics({});
+    _listener->onTimelineDensity(TimelineDensity());
+    _listener->onStatusText("");
+    _listener->onBagSize("");
+}
+
+void BagPlayer::update(void)
+{
+    if (!_loaded)
+        return;
+
+    // The density needs every message, it is computed once the indexing is over
+    if (_density_outdated && !_bags.isBuilding()) {
+        _density_outdated = false;
+        publishTimelineDensity();
+    }
+
+    publishPlayheadState();
+}
+
+void BagPlayer::publishPlayheadState(void)
+{
+    if (_publish_diagnostics)
+        publishDiagnostics();
+
+    bool       rates_changed = false;
+    const auto now           = std::chrono::steady_clock::now();
+    const auto elapsed       = std::chrono::duration<double>(now - _rate_window_start).count();
+    if (elapsed >= RATE_WINDOW_SECONDS) {
+        const auto messages     = _published_messages.load(std::memory_order_relaxed);
+        const auto bytes        = _published_bytes.load(std::memory_order_relaxed);
+        const auto publish_nsec = _publish_nsec.load(std::memory_order_relaxed);
+        const auto chunks       = _prefetcher.statistics();
+        const auto message_rate = (messages - _rate_window_messages) / elapsed;
+        const auto byte_rate    = (bytes - _rate_window_bytes) / elapsed;
+        const auto read_rate    = (chunks.read_bytes - _rate_window_chunks.read_bytes) / elapsed;
+        const auto read_load    = (chunks.read_nsec - _rate_window_chunks.read_nsec) * 1e-9 / elapsed;
+        const auto decode_load  = (chunks.decode_nsec - _rate_window_chunks.decode_nsec) * 1e-9 / elapsed;
+        const auto publish_load = (publish_nsec - _rate_window_publish_nsec) * 1e-9 / elapsed;
+
+        rates_changed = message_rate != _message_rate || byte_rate != _byte_rate || read_rate != _read_rate ||
+                        read_load != _read_load || decode_load != _decode_load || publish_load != _publish_load;
+        _message_rate             = message_rate;
+        _byte_rate                = byte_rate;
+        _read_rate                = read_rate;
+        _read_load                = read_load;
+        _decode_load              = decode_load;
+        _publish_load             = publish_load;
+        _rate_window_start        = now;
+        _rate_window_messages     = messages;
+        _rate_window_bytes        = bytes;
+        _rate_window_publish_nsec = publish_nsec;
+        _rate_window_chunks       = chunks;
+    }
+
+    // Once stopped, the state is still sent until the rates drop to zero
+    const auto playback         = _playback.load();
+    const auto playhead_nsec    = _playhead_nsec.load(std::memory_order_relaxed);
+    const auto dropped_messages = _dropped_messages.load(std::memory_order_relaxed);
+    if (playhead_nsec == _published_playhead_nsec && dropped_messages == _published_dropped_messages &&
+        playback.range_start == _published_range_start && playback.range_end == _published_range_end &&
+        playback.loop == _published_loop && !rates_changed)
+        return;
+
+    _published_playhead_nsec    = playhead_nsec;
+    _published_dropped_messages = dropped_messages;
+    _published_range_start      = playback.range_start;
+    _published_range_end        = playback.range_end;
+    _published_loop             = playback.loop;
+
+    PlayheadState state;
+    state.stamp.fromNSec(playhead_nsec);
+    state.bag_start      = _full_bag_start;
+    state.bag_end        = _full_bag_end;
+    state.range_start    = playback.range_start;
+    state.range_end      = playback.range_end;
+    state.loop           = playback.loop;
+    state.queue_depth    = _prefetcher.depth();
+    state.queue_capacity = _prefetcher.capacity();
+    state.max_lateness   = _max_lateness_nsec.exchange(0, std::memory_order_relaxed) * 1e-9;
+    state.message_rate   = _message_rate;
+    state.byte_rate      = _byte_rate;
+    state.read_rate      = _read_rate;
+    state.read_load      = _read_load;
+    state.decode_load    = _decode_load;
+    state.publish_load   = _publish_load;
+    for (std::size_t bin = 0; bin < state.lateness_histogram.size(); ++bin)
+        state.lateness_histogram[bin] = _lateness_histogram[bin].load(std::memory_order_relaxed);
+    state.dropped_messages = dropped_messages;
+    state.valid            = true;
+    _listener->onPlayheadState(state);
+}
+
+void BagPlayer::publishDiagnostics(void)
+{
+    const auto now     = std::chrono::steady_clock::now();
+    const auto elapsed = std::chrono::duration<double>(now - _diagnostics_window_start).count();
+    if (elapsed < 1.0 / _diagnostics_rate)
+        return;
+
+    const auto  messages     = _published_messages.load(std::memory_order_relaxed);
+    const auto  bytes        = _published_bytes.load(std::memory_order_relaxed);
+    const auto  publish_nsec = _publish_nsec.load(std::memory_order_relaxed);
+    const auto  dropped      = _dropped_messages.load(std::memory_order_relaxed);
+    const auto  lateness     = _diagnostics_max_lateness_nsec.exchange(0, std::memory_order_relaxed);
+    const auto  chunks       = _prefetcher.statistics();
+    const auto& previous     = _diagnostics_window_chunks;
+
+    // Some totals are reset when bags are loaded, their first window is then empty
+    const auto delta = [](const uint64_t total, const uint64_t previous) {
+        return total > previous ? total - previous : 0;
+    };
+    const auto per_second = [&delta, elapsed](const uint64_t total, const uint64_t previous, const double unit) {
+        return delta(total, previous) / elapsed / unit;
+    };
+    const auto value = [](const std::string& key, const double value, const int precision) {
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(precision) << value;
+
+        diagnostic_msgs::KeyValue key_value;
+        key_value.key   = key;
+        key_value.value = text.str();
+        return key_value;
+    };
+
+    using diagnostic_msgs::DiagnosticStatus;
+    const auto dropped_messages = delta(dropped, _diagnostics_window_dropped);
+
+    DiagnosticStatus playback;
+    playback.name        = "rosbag_rviz_panel: playback";
+    playback.hardware_id = "rosbag_rviz_panel";
+    playback.level       = dropped_messages > 0 ? DiagnosticStatus::WARN : DiagnosticStatus::OK;
+    playback.message     = dropped_messages > 0 ? "Dropping late messages" : (isPlaying() ? "Playing" : "Stopped");
+    playback.values      = {
+            value("Read MB/s", per_second(chunks.read_bytes, previous.read_bytes, 1e6), 2),
+            value("Read time ms/s", per_second(chunks.read_nsec, previous.read_nsec, 1e6), 2),
+            value("Chunks read/s", per_second(chunks.chunks, previous.chunks, 1.0), 1),
+            value("Decompressed MB/s", per_second(chunks.decoded_bytes, previous.decoded_bytes, 1e6), 2),
+            value("Decompression time ms/s", per_second(chunks.decode_nsec, previous.decode_nsec, 1e6), 2),
+            value("Chunk buffer allocations/s", per_second(chunks.allocations, previous.allocations, 1.0), 1),
+            value("Publish time ms/s", per_second(publish_nsec, _diagnostics_window_publish_nsec, 1e6), 2),
+            value("Published messages/s", per_second(messages, _diagnostics_window_messages, 1.0), 1),
+            value("Published MB/s", per_second(bytes, _diagnostics_window_bytes, 1e6), 2),
+            value("Max lateness ms", lateness * 1e-6, 2),
+            value("Dropped messages", dropped_messages, 0),
+            value("Read-ahead messages", _prefetcher.depth(), 0)};
+
+    diagnostic_msgs::DiagnosticArray array;
+    array.header.stamp = ros::Time::now();
+    array.status.push_back(std::move(playback));
+
+    // The connections of a topic in several bags are summed up
+    std::map<std::string, std::pair<uint64_t, uint64_t>> topics;
+    for (uint32_t id = 0; id < _connection_statistics.size(); ++id) {
+        const auto* pub            = connectionPublisher(id);
+        const auto  topic_messages = _connection_statistics[id].messages.load(std::memory_order_relaxed);
+        const auto  topic_bytes    = _connection_statistics[id].bytes.load(std::memory_order_relaxed);
+        if (pub != nullptr) {
+            auto& totals = topics[pub->connection->topic];
+            totals.first += delta(topic_messages, _diagnostics_window_connection_messages[id]);
+            totals.second += delta(topic_bytes, _diagnostics_window_connection_bytes[id]);
+        }
+
+        _diagnostics_window_connection_messages[id] = topic_messages;
+        _diagnostics_window_connection_bytes[id]    = topic_bytes;
+    }
+
+    for (const auto& topic : topics) {
+        DiagnosticStatus status;
+        status.name        = "rosbag_rviz_panel: " + topic.first;
+        status.hardware_id = "rosbag_rviz_panel";
+        status.level       = DiagnosticStatus::OK;
+        status.values      = {
+                value("Messages/s", topic.second.first / elapsed, 1),
+                value("MB/s", topic.second.second / elapsed / 1e6, 3)};
+        array.status.push_back(std::move(status));
+    }
+
+    _diagnostics_pub.publish(array);
+
+    _diagnostics_window_start        = now;
+    _diagnostics_window_messages     = messages;
+    _diagnostics_window_bytes        = bytes;
+    _diagnostics_window_publish_nsec = publish_nsec;
+    _diagnostics_window_dropped      = dropped;
+    _diagnostics_window_chunks       = chunks;
+}
+
+void BagPlayer::publishClock(void)
+{
+    ros::WallRate rate(_clock_rate);
+    while (_clock_running) {
+        const auto state = _playback.load();
+        const auto end   = state.control_end;
+        auto       clock = simTime(state);
+
+        // Not ahead of the messages still to be published, so late messages are not in the past
+        ros::Time next_stamp;
+        next_stamp.fromNSec(_next_stamp_nsec.load(std::memory_order_relaxed));
+        clock       = std::min(std::min(clock, next_stamp), end);
+        _clock_time = std::max(clock, _clock_time);
+
+        rosgraph_msgs::Clock msg;
+        msg.clock = _clock_time;
+        _clock_pub.publish(msg);
+
+        rate.sleep();
+    }
+}
+
+ros::Time BagPlayer::simTime(const PlaybackState& state) const
+{
+    if (!state.running)
+        return state.anchor;
+
+    ros::Time stamp;
+    if (state.unthrottled)
+        return stamp.fromNSec(_playhead_nsec.load(std::memory_order_relaxed));
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - state.play_start);
+    const auto nsec = static_cast<int64_t>(state.anchor.toNSec()) + static_cast<int64_t>(elapsed.count() * state.speed);
+    return stamp.fromNSec(static_cast<uint64_t>(std::max<int64_t>(nsec, 0)));
+}
+
+void BagPlayer::reanchorClock(PlaybackState& state) const
+{
+    state.anchor     = simTime(state);
+    state.play_start = std::chrono::steady_clock::now();
+}
+
+std::chrono::steady_clock::time_point BagPlayer::real_time(const PlaybackState& state, const ros::Time& msg_time)
+{
+    // Negative while playing backwards, as the message is before the anchor
+    const auto offset = std::chrono::duration<double>((msg_time - state.anchor).toSec() / state.speed);
+    return state.play_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(offset);
+}
+
+void BagPlayer::publishPlaybackSpeed(void)
+{
+    const auto state = _playback.load();
+    _listener->onPlaybackSpeed(state.speed, state.unthrottled);
+}
+
+ros::Time BagPlayer::getProgressTime(const double progress)
+{
+    auto      bag_duration = _full_bag_end.toSec() - _full_bag_start.toSec();
+    ros::Time new_start_stamp;
+    return new_start_stamp.fromSec(_full_bag_start.toSec() + bag_duration * progress);
+}
+
+void BagPlayer::publishTimelineDensity(void)
+{
+    const auto&       connections = _bags.connections();
+    std::vector<bool> filter(connections.size(), false);
+    for (uint32_t id = 0; id < connections.size(); ++id) {
+        const auto* info = connections[id].info;
+        if (info == nullptr)
+            continue;
+
+        filter[id] = _density_topic.empty() ? _selected_topics.count(info->topic) > 0 : info->topic == _density_topic;
+    }
+
+    TimelineDensity density;
+    density.messages.assign(DENSITY_BINS, 0);
+    density.bytes.assign(DENSITY_BINS, 0);
+
+    const auto   start    = _full_bag_start.toNSec();
+    const double duration = std::max<double>(_full_bag_end.toNSec() - start, 1.0);
+    for (std::size_t bag = 0; bag < _bags.size(); ++bag) {
+        const auto& index  = _bags.index(bag);
+        const auto& chunks = index.chunks();
+        const auto  base   = _bags.connectionBase(bag);
+
+        // The index has no message sizes, the bytes of a chunk up to the next one are shared by its messages,
+        // the last chunk ends where the index section starts
+        std::vector<uint64_t> message_bytes(chunks.size(), 0);
+        for (std::size_t chunk = 0; chunk < chunks.size(); ++chunk) {
+            const auto next = chunk + 1 < chunks.size() ? chunks[chunk + 1].pos : index.indexPos();
+            if (chunks[chunk].message_count > 0 && next > chunks[chunk].pos)
+                message_bytes[chunk] = (next - chunks[chunk].pos) / chunks[chunk].message_count;
+        }
+
+        for (std::size_t message = 0; message < index.size(); ++message) {
+            if (!filter[base + index.connectionId(message)])
+                continue;
+
+            const auto offset = static_cast<double>(index.stamp(message).toNSec() - start);
+            const auto bin    = std::min(static_cast<std::size_t>(offset / duration * DENSITY_BINS), DENSITY_BINS - 1);
+            ++density.messages[bin];
+            density.bytes[bin] += message_bytes[index.chunkId(message)];
+        }
+    }
+
+    _listener->onTimelineDensity(density);
+}
+} // namespace rosbag_rviz_panel
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "rosbag_rviz_panel/BagSet.h"
+
+#include <algorithm>
+
+namespace rosbag_rviz_panel {
+
+bool BagSet::add(const std::string& filename)
+{
+    auto index = std::make_unique<BagIndex>();
+
+    const bool mapped = index->mapSidecar(filename);
+    if (!mapped)
+        index->open(filename);
+
+    // The connections of the bag follow the ones of the previous bags
+    const auto base = static_cast<uint32_t>(_connections.size());
+    for (const auto& connection : index->connections()) {
+        const auto id = base + connection.first;
+        if (id >= _connections.size())
+            _connections.resize(id + 1);
+        _connections[id] = Connection{_indexes.size(), &connection.second};
+    }
+
+    _indexes.push_back(std::move(index));
+    _filenames.push_back(filename);
+    _connection_bases.push_back(base);
+
+    return mapped;
+}
+
+void BagSet::clear(void)
+{
+    _indexes.clear();
+    _filenames.clear();
+    _connection_bases.clear();
+    _connections.clear();
+}
+
+bool BagSet::isBuilding(void) const
+{
+    return std::any_of(_indexes.begin(), _indexes.end(), [](const std::unique_ptr<BagIndex>& index) {
+        return index->isBuilding();
+    });
+}
+
+uint64_t BagSet::fileSize(void) const
+{
+    uint64_t size = 0;
+    for (const auto& index : _indexes)
+        size += index->fileSize();
+
+    return size;
+}
+
+ros::Time BagSet::startTime(void) const
+{
+    ros::Time start;
+    bool      found = false;
+    for (const auto& index : _indexes) {
+        if (index->chunks().empty())
+            continue;
+
+        start = found ? std::min(start, index->startTime()) : index->startTime();
+        found = true;
+    }
+
+    return start;
+}
+
+ros::Time BagSet::endTime(void) const
+{
+    ros::Time end;
+    for (const auto& index : _indexes) {
+        if (!index->chunks().empty())
+            end = std::max(end, index->endTime());
+    }
+
+    return end;
+}
+
+} // namespace rosbag_rviz_panel
@@ -0,0 +1,376 @@
+#include "rosbag_rviz_panel/BagSource.h"
+
+#include <curl/curl.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace rosbag_rviz_panel {
+
+namespace {
+
+constexpr std::size_t REMOTE_BLOCK_SIZE   = 64 * 1024;
+constexpr std::size_t REMOTE_CACHE_BLOCKS = 256; // 16 MB by remote bag
+constexpr int         REMOTE_ATTEMPTS     = 3;
+constexpr long        HTTP_PARTIAL        = 206;
+
+/**
+ * @brief Rosbag on a local file system, NFS included, read with pread().
+ */
+class FileSource : public BagSource
+{
+  public:
+    explicit FileSource(const std::string& filename)
+    {
+        _fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (_fd < 0)
+            throw rosbag::BagIOException("Error opening file: " + filename);
+
+        struct stat file;
+        if (::fstat(_fd, &file) != 0) {
+            ::close(_fd);
+            throw rosbag::BagIOException("Error reading file: " + filename);
+        }
+
+        _size    = static_cast<uint64_t>(file.st_size);
+        _version = std::to_string(file.st_mtim.tv_sec) + "." + std::to_string(file.st_mtim.tv_nsec);
+    }
+
+    ~FileSource() override { ::close(_fd); }
+
+    uint64_t size(void) const override { return _size; }
+
+    const std::string& version(void) const override { return _version; }
+
+    int fd(void) const override { return _fd; }
+
+    void read(uint64_t offset, void* dst, std::size_t len) const override
+    {
+        auto* out = static_cast<uint8_t*>(dst);
+        while (len > 0) {
+            const ssize_t n = ::pread(_fd, out, len, static_cast<off_t>(offset));
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw rosbag::BagIOException(std::string("Error reading bag: ") + std::strerror(errno));
+            }
+            if (n == 0)
+                throw rosbag::BagIOException("Unexpected end of bag file");
+
+            out += n;
+            offset += static_cast<uint64_t>(n);
+            len -= static_cast<std::size_t>(n);
+        }
+    }
+
+  private:
+    int         _fd{-1};
+    uint64_t    _size{0};
+    std::string _version;
+};
+
+struct CurlDeleter
+{
+    void operator()(CURL* curl) const { curl_easy_cleanup(curl); }
+};
+
+using CurlHandle = std::unique_ptr<CURL, CurlDeleter>;
+
+/**
+ * @brief Buffer filled by the body of a response, which is aborted if
+ * it is longer than the buffer.
+ */
+struct Body
+{
+    uint8_t*    data;
+    std::size_t capacity;
+    std::size_t received{0};
+};
+
+std::size_t writeBody(char* data, std::size_t size, std::size_t count, void* user)
+{
+    auto*      body = static_cast<Body*>(user);
+    const auto len  = size * count;
+    if (len > body->capacity - body->received)
+        return 0;
+
+    std::memcpy(body->data + body->received, data, len);
+    body->received += len;
+    return len;
+}
+
+/**
+ * @brief Response headers needed to open a remote bag.
+ */
+struct Headers
+{
+    std::string content_range;
+    std::string etag;
+    std::string last_modified;
+};
+
+std::size_t readHeader(char* data, std::size_t size, std::size_t count, void* user)
+{
+    auto*             headers = static_cast<Headers*>(user);
+    const auto        len     = size * count;
+    const std::string line(data, len);
+
+    // The headers of a redirection are dropped with it
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        *headers = Headers();
+        return len;
+    }
+
+    const auto colon = line.find(':');
+    if (colon == std::string::npos)
+        return len;
+
+    std::string name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), [](const unsigned char c) { return std::tolower(c); });
+
+    const auto first = line.find_first_not_of(" \t", colon + 1);
+    const auto last  = line.find_last_not_of(" \t\r\n");
+    const auto value = first != std::string::npos && last >= first ? line.substr(first, last - first + 1) : "";
+
+    if (name == "content-range")
+        headers->content_range = value;
+    else if (name == "etag")
+        headers->etag = value;
+    else if (name == "last-modified")
+        headers->last_modified = value;
+
+    return len;
+}
+
+/**
+ * @brief Rosbag behind an http:// or https:// URL, read with range
+ * requests. The connections of the finished requests are kept open for
+ * the next ones.
+ */
+class HttpSource : public BagSource
+{
+  public:
+    explicit HttpSource(const std::string& url) : _url(url), _display_url(stripQuery(url))
+    {
+        // A GET of the first byte, since presigned URLs may only be valid for GET, which also checks range support
+        auto    curl = acquire();
+        Headers headers;
+        uint8_t first_byte;
+        Body    body{&first_byte, sizeof(first_byte)};
+        curl_easy_setopt(curl.get(), CURLOPT_URL, _url.c_str());
+        curl_easy_setopt(curl.get(), CURLOPT_RANGE, "0-0");
+        curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION, writeBody);
+        curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &body);
+        curl_easy_setopt(curl.get(), CURLOPT_HEADERFUNCTION, readHeader);
+        curl_easy_setopt(curl.get(), CURLOPT_HEADERDATA, &headers);
+
+        const auto code   = curl_easy_perform(curl.get());
+        long       status = 0;
+        curl_easy_getinfo(curl.get(), CURLINFO_RESPONSE_CODE, &status);
+        if (code != CURLE_OK && code != CURLE_WRITE_ERROR)
+            throw rosbag::BagIOException("Error opening " + _display_url + ": " + curl_easy_strerror(code));
+        if (status != HTTP_PARTIAL) {
+            const std::string error = status < 400 ? "the server does not support range requests"
+                                                   : "HTTP status " + std::to_string(status);
+            throw rosbag::BagIOException("Error opening " + _display_url + ": " + error);
+        }
+
+        // Content-Range: bytes 0-0/<size>
+        const auto slash = headers.content_range.rfind('/');
+        if (slash == std::string::npos || slash + 1 >= headers.content_range.size()
+            || !std::isdigit(static_cast<unsigned char>(headers.content_range[slash + 1])))
+            throw rosbag::BagIOException("Error opening " + _display_url + ": unknown size");
+
+        _size    = std::stoull(headers.content_range.substr(slash + 1));
+        _version = !headers.etag.empty() ? headers.etag : headers.last_modified;
+
+        curl_easy_setopt(curl.get(), CURLOPT_HEADERFUNCTION, nullptr);
+        curl_easy_setopt(curl.get(), CURLOPT_HEADERDATA, nullptr);
+        release(std::move(curl));
+    }
+
+    uint64_t size(void) const override { return _size; }
+
+    const std::string& version(void) const override { return _version; }
+
+    void read(uint64_t offset, void* dst, std::size_t len) const override
+    {
+        if (offset > _size || len > _size - offset)
+            throw rosbag::BagIOException("Unexpected end of bag file");
+        if (len == 0)
+            return;
+
+        auto* out = static_cast<uint8_t*>(dst);
+        if (len > REMOTE_BLOCK_SIZE) {
+            fetch(offset, out, len);
+            return;
+        }
+
+        // Copies the part of a block that overlaps the requested bytes
+        const auto copy = [offset, len, out](const uint64_t block_pos, const uint8_t* data, const std::size_t size) {
+            const auto begin = std::max(offset, block_pos);
+            const auto end   = std::min(offset + len, block_pos + size);
+            if (begin < end)
+                std::memcpy(out + (begin - offset), data + (begin - block_pos), end - begin);
+        };
+
+        const uint64_t first = offset / REMOTE_BLOCK_SIZE;
+        const uint64_t last  = (offset + len - 1) / REMOTE_BLOCK_SIZE;
+
+        // The cached blocks are copied up to the first missing one, which is fetched with the rest at once
+        uint64_t block = first;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (; block <= last; ++block) {
+                const auto cached = _block_index.find(block);
+                if (cached == _block_index.end())
+                    break;
+
+                _blocks.splice(_blocks.begin(), _blocks, cached->second);
+                copy(block * REMOTE_BLOCK_SIZE, cached->second->second.data(), cached->second->second.size());
+            }
+        }
+        if (block > last)
+            return;
+
+        const auto           fetch_pos = block * REMOTE_BLOCK_SIZE;
+        const auto           fetch_end = std::min((last + 1) * REMOTE_BLOCK_SIZE, _size);
+        std::vector<uint8_t> fetched(static_cast<std::size_t>(fetch_end - fetch_pos));
+        fetch(fetch_pos, fetched.data(), fetched.size());
+        copy(fetch_pos, fetched.data(), fetched.size());
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (std::size_t pos = 0; pos < fetched.size(); pos += REMOTE_BLOCK_SIZE, ++block) {
+            if (_block_index.count(block) > 0)
+                continue;
+
+            const auto size = std::min(REMOTE_BLOCK_SIZE, fetched.size() - pos);
+            _blocks.emplace_front(block, std::vector<uint8_t>(fetched.begin() + pos, fetched.begin() + pos + size));
+            _block_index[block] = _blocks.begin();
+
+            if (_blocks.size() > REMOTE_CACHE_BLOCKS) {
+                _block_index.erase(_blocks.back().first);
+                _blocks.pop_back();
+            }
+        }
+    }
+
+  private:
+    using BlockList = std::list<std::pair<uint64_t, std::vector<uint8_t>>>;
+
+    /**
+     * @brief Returns an idle handle, or a new one.
+     */
+    CurlHandle acquire(void) const
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_handles.empty()) {
+                auto curl = std::move(_handles.back());
+                _handles.pop_back();
+                return curl;
+            }
+        }
+
+        static std::once_flag initialized;
+        std::call_once(initialized, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+        CurlHandle curl(curl_easy_init());
+        if (!curl)
+            throw rosbag::BagIOException("Error creating an HTTP client for " + _display_url);
+
+        // The requests are made by the decoding threads, a stalled one fails instead of blocking playback
+        curl_easy_setopt(curl.get(), CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(curl.get(), CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl.get(), CURLOPT_CONNECTTIMEOUT, 10L);
+        curl_easy_setopt(curl.get(), CURLOPT_LOW_SPEED_LIMIT, 1024L);
+        curl_easy_setopt(curl.get(), CURLOPT_LOW_SPEED_TIME, 30L);
+        return curl;
+    }
+
+    /**
+     * @brief Keeps a handle, and its connection, for the next request.
+     */
+    void release(CurlHandle curl) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _handles.push_back(std::move(curl));
+    }
+
+    /**
+     * @brief Fetches a range of the rosbag with a single request,
+     * retried on a new connection if it fails.
+     */
+    void fetch(const uint64_t offset, uint8_t* dst, const std::size_t len) const
+    {
+        const auto range = std::to_string(offset) + "-" + std::to_string(offset + len - 1);
+        for (int attempt = 1;; ++attempt) {
+            auto curl = acquire();
+            Body body{dst, len};
+            curl_easy_setopt(curl.get(), CURLOPT_URL, _url.c_str());
+            curl_easy_setopt(curl.get(), CURLOPT_RANGE, range.c_str());
+            curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION, writeBody);
+            curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &body);
+
+            const auto code   = curl_easy_perform(curl.get());
+            long       status = 0;
+            curl_easy_getinfo(curl.get(), CURLINFO_RESPONSE_CODE, &status);
+            if (code == CURLE_OK && status == HTTP_PARTIAL && body.received == len) {
+                release(std::move(curl));
+                return;
+            }
+
+            // A complete answer means that the server ignored the range, asking again does not help
+            std::string error = code != CURLE_OK && code != CURLE_WRITE_ERROR ? curl_easy_strerror(code)
+                                : status == 200          ? "the server does not support range requests"
+                                : status != HTTP_PARTIAL ? "HTTP status " + std::to_string(status)
+                                                         : "incomplete response";
+            if (attempt == REMOTE_ATTEMPTS || (status > 0 && status != HTTP_PARTIAL && status < 500))
+                throw rosbag::BagIOException("Error reading " + _display_url + ": " + error);
+        }
+    }
+
+    std::string _url;
+    std::string _display_url; // Without the query, which may hold credentials
+    uint64_t    _size{0};
+    std::string _version;
+
+    mutable std::mutex              _mutex;
+    mutable std::vector<CurlHandle> _handles; // Idle, with their connection still open
+
+    // Most recent first
+    mutable BlockList                                         _blocks;
+    mutable std::unordered_map<uint64_t, BlockList::iterator> _block_index;
+};
+
+} // namespace
+
+std::unique_ptr<BagSource> BagSource::open(const std::string& location)
+{
+    if (isRemote(location))
+        return std::make_unique<HttpSource>(location);
+
+    return std::make_unique<FileSource>(location);
+}
+
+bool BagSource::isRemote(const std::string& location)
+{
+    return location.compare(0, 7, "http://") == 0 || location.compare(0, 8, "https://") == 0;
+}
+
+std::string BagSource::stripQuery(const std::string& location)
+{
+    return isRemote(location) ? location.substr(0, location.find_first_of("?#")) : location;
+}
+
+} // namespace rosbag_rviz_panel
@@ -0,0 +1,50 @@
+#include "rosbag_rviz_panel/ChunkCache.h"
+
+namespace rosbag_rviz_panel {
+
+void ChunkCache::setCapacity(const std::size_t max_bytes)
+{
+    _max_bytes = max_bytes;
+    evict(_max_bytes);
+}
+
+const ChunkData* ChunkCache::find(const std::size_t bag, const uint32_t chunk_id)
+{
+    const auto entry = _lookup.find(key(bag, chunk_id));
+    if (entry == _lookup.end())
+        return nullptr;
+
+    _entries.splice(_entries.begin(), _entries, entry->second);
+    return &entry->second->chunk;
+}
+
+void ChunkCache::insert(const std::size_t bag, const uint32_t chunk_id, const ChunkData& chunk)
+{
+    // A mapped chunk is read from the page cache again, without decompressing it
+    if (chunk.mapped || chunk.size > _max_bytes || find(bag, chunk_id) != nullptr)
+        return;
+
+    evict(_max_bytes - chunk.size);
+
+    _entries.push_front(Entry{key(bag, chunk_id), chunk});
+    _lookup[_entries.front().key] = _entries.begin();
+    _bytes += chunk.size;
+}
+
+void ChunkCache::clear(void)
+{
+    _entries.clear();
+    _lookup.clear();
+    _bytes = 0;
+}
+
+void ChunkCache::evict(const std::size_t max_bytes)
+{
+    while (_bytes > max_bytes) {
+        _bytes -= _entries.back().chunk.size;
+        _lookup.erase(_entries.back().key);
+        _entries.pop_back();
+    }
+}
+
+} // namespace rosbag_rviz_panel
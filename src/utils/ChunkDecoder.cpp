@@ -0,0 +1,78 @@
+#include "rosbag_rviz_panel/ChunkDecoder.h"
+
+namespace rosbag_rviz_panel {
+
+ChunkDecoder::~ChunkDecoder()
+{
+    stop();
+}
+
+void ChunkDecoder::start(const std::size_t threads)
+{
+    stop();
+
+    _quit = false;
+    for (std::size_t i = 0; i < threads; ++i)
+        _threads.emplace_back(&ChunkDecoder::work, this);
+}
+
+void ChunkDecoder::stop(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.clear();
+        _quit = true;
+    }
+    _work_cv.notify_all();
+
+    for (auto& thread : _threads)
+        thread.join();
+    _threads.clear();
+}
+
+std::shared_future<ChunkData> ChunkDecoder::decode(const ChunkReader& reader, const BagIndex::ChunkInfo& chunk)
+{
+    std::packaged_task<ChunkData()> task([&reader, chunk]() { return reader.readChunk(chunk); });
+    auto                            future = task.get_future().share();
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(std::move(task));
+    }
+    _work_cv.notify_one();
+
+    return future;
+}
+
+void ChunkDecoder::cancel(void)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // The dropped chunks get a broken promise, their requester is gone
+    _queue.clear();
+    _idle_cv.wait(lock, [this]() { return _running == 0; });
+}
+
+void ChunkDecoder::work(void)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        _work_cv.wait(lock, [this]() { return _quit || !_queue.empty(); });
+        if (_quit)
+            return;
+
+        auto task = std::move(_queue.front());
+        _queue.pop_front();
+        ++_running;
+
+        // Decoded without the lock, the errors are stored in the future
+        lock.unlock();
+        task();
+        lock.lock();
+
+        --_running;
+        _idle_cv.notify_all();
+    }
+}
+
+} // namespace rosbag_rviz_panel
@@ -0,0 +1,76 @@
+#include "rosbag_rviz_panel/ChunkPool.h"
+
+#include <algorithm>
+
+namespace rosbag_rviz_panel {
+
+void ChunkPool::setCapacity(const std::size_t max_bytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _max_bytes = max_bytes;
+    trim(_max_bytes);
+}
+
+boost::shared_array<uint8_t> ChunkPool::acquire(const std::size_t size)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // No other thread can take a reference to a buffer that only the pool holds
+    Buffer* best = nullptr;
+    for (auto& buffer : _buffers) {
+        if (buffer.data.use_count() == 1 && buffer.capacity >= size && (!best || buffer.capacity < best->capacity))
+            best = &buffer;
+    }
+    if (best != nullptr)
+        return best->data;
+
+    // Rounded up, so the chunks of similar sizes share the buffers
+    const std::size_t granule  = std::max<std::size_t>(64 * 1024, size / 8);
+    const std::size_t capacity = std::max<std::size_t>((size + granule - 1) / granule * granule, 1);
+
+    trim(_max_bytes > capacity ? _max_bytes - capacity : 0);
+    _buffers.push_back(Buffer{boost::shared_array<uint8_t>(new uint8_t[capacity]), capacity});
+    ++_allocations;
+
+    return _buffers.back().data;
+}
+
+uint64_t ChunkPool::allocations(void) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _allocations;
+}
+
+void ChunkPool::clear(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    trim(0);
+}
+
+void ChunkPool::trim(const std::size_t max_bytes)
+{
+    std::size_t free_bytes = 0;
+    for (const auto& buffer : _buffers) {
+        if (buffer.data.use_count() == 1)
+            free_bytes += buffer.capacity;
+    }
+
+    // The largest free buffers are dropped first, they hold the most memory
+    std::sort(_buffers.begin(), _buffers.end(), [](const Buffer& a, const Buffer& b) {
+        return a.capacity > b.capacity;
+    });
+    _buffers.erase(
+            std::remove_if(
+                    _buffers.begin(),
+                    _buffers.end(),
+                    [&free_bytes, max_bytes](const Buffer& buffer) {
+                        if (free_bytes <= max_bytes || buffer.data.use_count() > 1)
+                            return false;
+
+                        free_bytes -= buffer.capacity;
+                        return true;
+                    }),
+            _buffers.end());
+}
+
+} // namespace rosbag_rviz_panel
@@ -0,0 +1,309 @@
+#include "rosbag_rviz_panel/ChunkReader.h"
+
+#include <bzlib.h>
+#include <roslz4/lz4s.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+
+#include "rosbag_rviz_panel/BagFormat.h"
+
+namespace rosbag_rviz_panel {
+
+ChunkStatistics& ChunkStatistics::operator+=(const ChunkStatistics& other)
+{
+    chunks        += other.chunks;
+    read_bytes    += other.read_bytes;
+    read_nsec     += other.read_nsec;
+    decoded_bytes += other.decoded_bytes;
+    decode_nsec   += other.decode_nsec;
+    allocations   += other.allocations;
+    return *this;
+}
+
+ChunkReader::~ChunkReader()
+{
+    close();
+}
+
+void ChunkReader::open(const std::string& filename, const bool map)
+{
+    close();
+
+    _source = BagSource::open(filename);
+
+    // Only a local file can be mapped
+    if (!map || _source->fd() < 0 || _source->size() == 0)
+        return;
+
+    // The messages may outlive the reader, the last one pointing into the mapping unmaps it
+    const auto size    = static_cast<std::size_t>(_source->size());
+    void*      address = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, _source->fd(), 0);
+    if (address == MAP_FAILED)
+        return;
+
+    _mapping      = boost::shared_array<uint8_t>(static_cast<uint8_t*>(address), [size](uint8_t* mapped) {
+        ::munmap(mapped, size);
+    });
+    _mapping_size = size;
+}
+
+void ChunkReader::close(void)
+{
+    _source.reset();
+    _chunk_loaded = false;
+    _mapping.reset();
+    _mapping_size = 0;
+    _chunk.reset();
+    _chunk_size     = 0;
+    _chunk_capacity = 0;
+    std::vector<uint8_t>().swap(_compressed);
+}
+
+MessageData ChunkReader::readMessage(const BagIndex& index, const std::size_t message)
+{
+    const auto chunk_id = index.chunkId(message);
+    if (!_chunk_loaded || _chunk_id != chunk_id) {
+        _chunk_loaded = false;
+        loadChunk(index.chunks().at(chunk_id));
+        _chunk_id     = chunk_id;
+        _chunk_loaded = true;
+    }
+
+    // Message records are <header_len><header><data_len><data>, the header is not needed
+    uint64_t pos = index.offset(message);
+    uint32_t header_len, data_len;
+    if (pos + sizeof(header_len) > _chunk_size)
+        throw rosbag::BagFormatException("Message offset out of the chunk");
+    std::memcpy(&header_len, _chunk.get() + pos, sizeof(header_len));
+    pos += sizeof(header_len) + header_len;
+
+    if (pos + sizeof(data_len) > _chunk_size)
+        throw rosbag::BagFormatException("Message header out of the chunk");
+    std::memcpy(&data_len, _chunk.get() + pos, sizeof(data_len));
+    pos += sizeof(data_len);
+
+    if (pos + data_len > _chunk_size)
+        throw rosbag::BagFormatException("Message data out of the chunk");
+
+    return MessageData{_chunk, _chunk.get() + pos, data_len};
+}
+
+namespace {
+
+/**
+ * @brief Reads and decompresses a chunk.
+ *
+ * @param bag Pointer to the BagSource of the rosbag, or nullptr if
+ *        it is not open.
+ * @param mapping Pointer to the rosbag mapped in memory, or nullptr to
+ *        read the chunk from the file.
+ * @param mapping_size std::size_t with the size of the mapping.
+ * @param chunk BagIndex::ChunkInfo with the chunk location.
+ * @param compressed std::vector<uint8_t> used to read the compressed data.
+ * @param statistics ChunkStatistics set to the statistics of the chunk.
+ * @param stored Pointer set to the data of an uncompressed chunk in the
+ *        mapping, which is then not copied, or to nullptr.
+ * @param allocate Callable returning a buffer of at least the given size
+ *        for the decompressed chunk.
+ *
+ * @return std::size_t with the decompressed size.
+ */
+template <typename Allocate>
+std::size_t decodeChunk(
+        const BagSource*           bag,
+        const uint8_t*             mapping,
+        const std::size_t          mapping_size,
+        const BagIndex::ChunkInfo& chunk,
+        std::vector<uint8_t>&      compressed,
+        ChunkStatistics&           statistics,
+        const uint8_t*&            stored,
+        Allocate&&                 allocate)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto nsec_since = [](const Clock::time_point& start) {
+        return static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    };
+
+    if (bag == nullptr)
+        throw rosbag::BagIOException("Bag is not open");
+
+    const auto read_start = Clock::now();
+    const auto record     = mapping != nullptr ? bag_format::readRecord(mapping, mapping_size, chunk.pos)
+                                               : bag_format::readRecord(*bag, chunk.pos);
+    if (bag_format::readOp(record.fields) != bag_format::OP_CHUNK)
+        throw rosbag::BagFormatException("Expected CHUNK op not found");
+
+    const auto compression = record.fields.find("compression");
+    if (compression == record.fields.end())
+        throw rosbag::BagFormatException("Required 'compression' field missing");
+
+    statistics            = ChunkStatistics();
+    statistics.chunks     = 1;
+    statistics.read_bytes = record.data_len;
+    stored                = nullptr;
+
+    // The pages of the mapping are read by the kernel when they are first touched
+    if (compression->second == "none") {
+        if (mapping != nullptr)
+            stored = mapping + record.data_pos;
+        else
+            bag->read(record.data_pos, allocate(record.data_len), record.data_len);
+        statistics.read_nsec     = nsec_since(read_start);
+        statistics.decoded_bytes = record.data_len;
+        return record.data_len;
+    }
+
+    const uint8_t* source = mapping + record.data_pos;
+    if (mapping == nullptr) {
+        compressed.resize(record.data_len);
+        bag->read(record.data_pos, compressed.data(), compressed.size());
+        source = compressed.data();
+    }
+    statistics.read_nsec = nsec_since(read_start);
+
+    const auto   decode_start = Clock::now();
+    unsigned int size         = bag_format::readUInt32(record.fields, "size");
+    uint8_t*     buffer       = allocate(size);
+
+    if (compression->second == "bz2") {
+        const int ret = BZ2_bzBuffToBuffDecompress(
+                reinterpret_cast<char*>(buffer),
+                &size,
+                const_cast<char*>(reinterpret_cast<const char*>(source)),
+                record.data_len,
+                0,
+                0);
+        if (ret != BZ_OK)
+            throw rosbag::BagFormatException("Error decompressing bz2 chunk: " + std::to_string(ret));
+    } else if (compression->second == "lz4") {
+        const int ret = roslz4_buffToBuffDecompress(
+                const_cast<char*>(reinterpret_cast<const char*>(source)),
+                record.data_len,
+                reinterpret_cast<char*>(buffer),
+                &size);
+        if (ret != ROSLZ4_OK)
+            throw rosbag::BagFormatException("Error decompressing lz4 chunk: " + std::to_string(ret));
+    } else
+        throw rosbag::BagFormatException("Unknown compression: " + compression->second);
+
+    statistics.decode_nsec   = nsec_since(decode_start);
+    statistics.decoded_bytes = size;
+    return size;
+}
+
+} // namespace
+
+ChunkData ChunkReader::readChunk(const BagIndex::ChunkInfo& chunk) const
+{
+    // Kept by each decoding thread for its next chunks
+    thread_local std::vector<uint8_t> compressed;
+
+    ChunkData       decoded;
+    ChunkStatistics statistics;
+    const uint8_t*  stored = nullptr;
+
+    const auto buffer = [this, &decoded](const std::size_t size) {
+        decoded.data = allocate(size);
+        return decoded.data.get();
+    };
+    decoded.size = decodeChunk(
+            _source.get(), _mapping.get(), _mapping_size, chunk, compressed, statistics, stored, buffer);
+    record(statistics);
+
+    // Shares the ownership of the mapping
+    if (stored != nullptr) {
+        decoded.data   = boost::shared_array<uint8_t>(_mapping, const_cast<uint8_t*>(stored));
+        decoded.mapped = true;
+    }
+
+    return decoded;
+}
+
+void ChunkReader::advise(const BagIndex::ChunkInfo& chunk) const
+{
+    if (!_mapping)
+        return;
+
+    const auto record = bag_format::readRecord(_mapping.get(), _mapping_size, chunk.pos);
+
+    // madvise() needs an address aligned to a page
+    static const auto page  = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    const auto        start = chunk.pos / page * page;
+    ::madvise(_mapping.get() + start, record.nextPos() - start, MADV_WILLNEED);
+}
+
+void ChunkReader::setChunk(const uint32_t chunk_id, const ChunkData& chunk)
+{
+    _chunk          = chunk.data;
+    _chunk_size     = chunk.size;
+    _chunk_capacity = chunk.mapped ? 0 : chunk.size;
+    _chunk_id       = chunk_id;
+    _chunk_loaded   = true;
+}
+
+void ChunkReader::loadChunk(const BagIndex::ChunkInfo& chunk)
+{
+    ChunkStatistics statistics;
+    const uint8_t*  stored = nullptr;
+
+    const auto buffer = [this](const std::size_t size) {
+        reserveChunk(size);
+        return _chunk.get();
+    };
+    _chunk_size = decodeChunk(
+            _source.get(), _mapping.get(), _mapping_size, chunk, _compressed, statistics, stored, buffer);
+    record(statistics);
+
+    // The chunk buffer is not reused, the next chunk gets a new one
+    if (stored != nullptr) {
+        _chunk          = boost::shared_array<uint8_t>(_mapping, const_cast<uint8_t*>(stored));
+        _chunk_capacity = 0;
+    }
+}
+
+ChunkStatistics ChunkReader::statistics(void) const
+{
+    ChunkStatistics totals;
+    totals.chunks        = _chunks.load(std::memory_order_relaxed);
+    totals.read_bytes    = _read_bytes.load(std::memory_order_relaxed);
+    totals.read_nsec     = _read_nsec.load(std::memory_order_relaxed);
+    totals.decoded_bytes = _decoded_bytes.load(std::memory_order_relaxed);
+    totals.decode_nsec   = _decode_nsec.load(std::memory_order_relaxed);
+    totals.allocations   = _allocations.load(std::memory_order_relaxed);
+    return totals;
+}
+
+boost::shared_array<uint8_t> ChunkReader::allocate(const std::size_t size) const
+{
+    if (_pool != nullptr)
+        return _pool->acquire(size);
+
+    _allocations.fetch_add(1, std::memory_order_relaxed);
+    return boost::shared_array<uint8_t>(new uint8_t[size]);
+}
+
+void ChunkReader::record(const ChunkStatistics& chunk) const
+{
+    _chunks.fetch_add(chunk.chunks, std::memory_order_relaxed);
+    _read_bytes.fetch_add(chunk.read_bytes, std::memory_order_relaxed);
+    _read_nsec.fetch_add(chunk.read_nsec, std::memory_order_relaxed);
+    _decoded_bytes.fetch_add(chunk.decoded_bytes, std::memory_order_relaxed);
+    _decode_nsec.fetch_add(chunk.decode_nsec, std::memory_order_relaxed);
+}
+
+void ChunkReader::reserveChunk(const std::size_t size)
+{
+    // Messages still being published keep the previous chunk, which is then left to them
+    if (!_chunk || _chunk.use_count() > 1 || _chunk_capacity < size) {
+        _chunk          = allocate(size);
+        _chunk_capacity = size;
+    }
+
+    _chunk_size = 0;
+}
+
+} // namespace rosbag_rviz_panel
@@ -0,0 +1,459 @@
+#include "rosbag_rviz_panel/MessagePrefetcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iterator>
+#include <queue>
+
+namespace rosbag_rviz_panel {
+
+namespace {
+
+/**
+ * @brief Next message of a bag in the k-way merge.
+ */
+struct Cursor
+{
+    ros::Time   stamp;
+    std::size_t bag;
+    std::size_t message;
+};
+
+} // namespace
+
+MessagePrefetcher::MessagePrefetcher(const BagSet& bags) : _bags(bags) {}
+
+MessagePrefetcher::~MessagePrefetcher()
+{
+    close();
+}
+
+void MessagePrefetcher::open(void)
+{
+    close();
+    _cache.clear();
+
+    // One stream per bag, so reading a bag does not seek away from the chunks of the others
+    for (std::size_t bag = 0; bag < _bags.size(); ++bag) {
+        _readers.push_back(std::make_unique<ChunkReader>());
+        _readers.back()->setPool(&_pool);
+        _readers.back()->open(_bags.filename(bag), _memory_mapped);
+    }
+}
+
+void MessagePrefetcher::close(void)
+{
+    // The reading thread cancels its chunks before finishing, so the decoder no longer uses the readers
+    stop();
+    for (const auto& reader : _readers)
+        _closed_statistics += reader->statistics();
+    _readers.clear();
+    _cache.clear();
+    _pool.clear();
+
+    std::vector<PrefetchedMessage>().swap(_slots);
+}
+
+void MessagePrefetcher::setCapacity(const std::size_t max_messages, const std::size_t max_bytes)
+{
+    _max_messages = std::max<std::size_t>(max_messages, 1);
+    _max_bytes    = max_bytes;
+    _pool.setCapacity(max_bytes);
+}
+
+void MessagePrefetcher::setConnectionFilter(std::vector<bool> connections)
+{
+    _connection_filter = std::move(connections);
+}
+
+void MessagePrefetcher::setDecodeThreads(const std::size_t threads)
+{
+    // A single decoding thread would only move the decompression away from the reading thread
+    _decoder.start(threads > 1 ? threads : 0);
+    _decode_ahead = 2 * _decoder.threads();
+}
+
+void MessagePrefetcher::setCacheCapacity(const std::size_t max_bytes)
+{
+    _cache.setCapacity(max_bytes);
+}
+
+void MessagePrefetcher::start(const ros::Time& start, const ros::Time& end, const bool forward)
+{
+    stop();
+
+    // Releases the chunks still held by the slots of the previous run
+    _slots.assign(_max_messages, PrefetchedMessage());
+    _run_connection_filter = _connection_filter;
+    _run_forward           = forward;
+
+    {
+        // wake() may be called from another thread at any time
+        std::lock_guard<std::mutex> lock(_mutex);
+        _head        = 0;
+        _count       = 0;
+        _bytes       = 0;
+        _finished    = false;
+        _interrupted = false;
+        _woken       = false;
+        _error.clear();
+        _depth = 0;
+    }
+
+    _thread = std::thread(&MessagePrefetcher::run, this, start, end, forward);
+}
+
+MessageData MessagePrefetcher::readMessage(const std::size_t bag, const std::size_t message)
+{
+    const auto& index = _bags.index(bag);
+    loadChunk(bag, index.chunkId(message));
+
+    return _readers[bag]->readMessage(index, message);
+}
+
+const PrefetchedMessage* MessagePrefetcher::front(void)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _not_empty.wait(lock, [this]() { return _count > 0 || _finished || _interrupted || _woken; });
+
+    if (_woken) {
+        _woken = false;
+        return nullptr;
+    }
+
+    if (_interrupted || _count == 0)
+        return nullptr;
+
+    return &_slots[_head];
+}
+
+bool MessagePrefetcher::done(void) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _interrupted || (_finished && _count == 0);
+}
+
+void MessagePrefetcher::pop(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_count == 0)
+            return;
+
+        // Drops the chunk reference, the chunk is freed once no message holds it
+        _bytes             -= _slots[_head].data.size;
+        _slots[_head].data  = MessageData();
+        _head               = (_head + 1) % _slots.size();
+        --_count;
+        _depth = _count;
+    }
+
+    _not_full.notify_one();
+}
+
+void MessagePrefetcher::wake(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _woken = true;
+    }
+
+    _not_empty.notify_all();
+}
+
+void MessagePrefetcher::interrupt(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _interrupted = true;
+    }
+
+    _not_empty.notify_all();
+    _not_full.notify_all();
+}
+
+void MessagePrefetcher::stop(void)
+{
+    interrupt();
+
+    if (_thread.joinable())
+        _thread.join();
+}
+
+ChunkStatistics MessagePrefetcher::statistics(void) const
+{
+    auto totals = _closed_statistics;
+    for (const auto& reader : _readers)
+        totals += reader->statistics();
+    totals.allocations += _pool.allocations();
+
+    return totals;
+}
+
+std::string MessagePrefetcher::error(void) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _error;
+}
+
+void MessagePrefetcher::run(const ros::Time start, const ros::Time end, const bool forward)
+{
+    try {
+        if (forward ? readForward(start, end) : readBackwards(start, end))
+            flush();
+    } catch (const std::exception& e) {
+        // Any error ends the read-ahead and is reported, an exception leaving the thread would abort
+        std::lock_guard<std::mutex> lock(_mutex);
+        _error = e.what();
+    }
+
+    // The chunks still decoded ahead are no longer needed
+    _decoder.cancel();
+    _pending_chunks.clear();
+    _pending_messages.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _finished = true;
+    }
+    _not_empty.notify_all();
+}
+
+bool MessagePrefetcher::readForward(const ros::Time& start, const ros::Time& end)
+{
+    // Min-heap by time stamp, equal stamps are read in the order of the bags in the set
+    const auto later = [](const Cursor& a, const Cursor& b) {
+        return a.stamp > b.stamp || (a.stamp == b.stamp && a.bag > b.bag);
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heap(later);
+
+    // Adds the first selected message of the range from a message of a bag, if any
+    const auto push_next = [this, &heap, &start, &end](const std::size_t bag, std::size_t message) {
+        const auto& index = _bags.index(bag);
+        for (;; ++message) {
+            // While the bag is being indexed, wait for the messages after the indexing front
+            while (message >= index.size() && index.isBuilding()) {
+                // The messages already merged are not held back by the indexing
+                if (!flush())
+                    return;
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (_interrupted)
+                        return;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+
+            if (message >= index.size() || index.stamp(message) > end)
+                return;
+
+            // The search may have started before the range if the bag was still being indexed
+            const auto connection_id = _bags.connectionBase(bag) + index.connectionId(message);
+            if (index.stamp(message) >= start && isSelected(connection_id)) {
+                heap.push(Cursor{index.stamp(message), bag, message});
+                return;
+            }
+        }
+    };
+
+    for (std::size_t bag = 0; bag < _bags.size(); ++bag)
+        push_next(bag, _bags.index(bag).lowerBound(start));
+
+    while (!heap.empty()) {
+        const auto cursor = heap.top();
+        heap.pop();
+
+        if (!enqueue(cursor.bag, cursor.message))
+            return false;
+
+        push_next(cursor.bag, cursor.message + 1);
+    }
+
+    return true;
+}
+
+bool MessagePrefetcher::readBackwards(const ros::Time& start, const ros::Time& end)
+{
+    // Max-heap by time stamp, equal stamps are read in the reverse order of the bags
+    const auto earlier = [](const Cursor& a, const Cursor& b) {
+        return a.stamp < b.stamp || (a.stamp == b.stamp && a.bag < b.bag);
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(earlier)> heap(earlier);
+
+    std::vector<std::size_t> firsts(_bags.size());
+
+    // Adds the last selected message of the range before a message of a bag, if any
+    const auto push_previous = [this, &heap, &firsts](const std::size_t bag, std::size_t message) {
+        const auto& index = _bags.index(bag);
+        while (message-- > firsts[bag]) {
+            if (isSelected(_bags.connectionBase(bag) + index.connectionId(message))) {
+                heap.push(Cursor{index.stamp(message), bag, message});
+                return;
+            }
+        }
+    };
+
+    for (std::size_t bag = 0; bag < _bags.size(); ++bag) {
+        firsts[bag] = _bags.index(bag).lowerBound(start);
+        push_previous(bag, _bags.index(bag).upperBound(end));
+    }
+
+    while (!heap.empty()) {
+        const auto cursor = heap.top();
+        heap.pop();
+
+        if (!enqueue(cursor.bag, cursor.message))
+            return false;
+
+        push_previous(cursor.bag, cursor.message);
+    }
+
+    return true;
+}
+
+bool MessagePrefetcher::isSelected(const uint32_t connection_id) const
+{
+    if (_run_connection_filter.empty())
+        return true;
+
+    return connection_id < _run_connection_filter.size() && _run_connection_filter[connection_id];
+}
+
+void MessagePrefetcher::loadChunk(const std::size_t bag, const uint32_t chunk_id)
+{
+    // The chunk is decoded into a new buffer to be kept, unless it is already cached
+    auto& reader = *_readers[bag];
+    if (_cache.capacity() == 0 || reader.hasChunk(chunk_id))
+        return;
+
+    const auto* cached = _cache.find(bag, chunk_id);
+    const auto  chunk  = cached != nullptr ? *cached : reader.readChunk(_bags.index(bag).chunks().at(chunk_id));
+    reader.setChunk(chunk_id, chunk);
+    _cache.insert(bag, chunk_id, chunk);
+}
+
+void MessagePrefetcher::adviseNext(const std::size_t bag, const uint32_t chunk_id)
+{
+    // The chunks are indexed in the order of the file, which is the order of their time stamps
+    const auto& chunks = _bags.index(bag).chunks();
+    if (_run_forward && chunk_id + 1 < chunks.size())
+        _readers[bag]->advise(chunks[chunk_id + 1]);
+    else if (!_run_forward && chunk_id > 0)
+        _readers[bag]->advise(chunks[chunk_id - 1]);
+}
+
+bool MessagePrefetcher::push(const std::size_t bag, const std::size_t message)
+{
+    std::size_t slot;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_full.wait(lock, [this]() {
+            return _interrupted || _count == 0 || (_count < _slots.size() && _bytes < _max_bytes);
+        });
+
+        if (_interrupted)
+            return false;
+
+        slot = (_head + _count) % _slots.size();
+    }
+
+    const auto& index    = _bags.index(bag);
+    const auto  chunk_id = index.chunkId(message);
+    if (_readers[bag]->isMapped() && !_readers[bag]->hasChunk(chunk_id))
+        adviseNext(bag, chunk_id);
+    loadChunk(bag, chunk_id);
+
+    // The free slot is only touched by this thread until it is pushed
+    auto&       prefetched   = _slots[slot];
+    prefetched.bag           = bag;
+    prefetched.message       = message;
+    prefetched.stamp         = index.stamp(message);
+    prefetched.connection_id = _bags.connectionBase(bag) + index.connectionId(message);
+    prefetched.data          = _readers[bag]->readMessage(index, message);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _bytes += prefetched.data.size;
+        ++_count;
+        _depth = _count;
+    }
+    _not_empty.notify_one();
+
+    return true;
+}
+
+bool MessagePrefetcher::enqueue(const std::size_t bag, const std::size_t message)
+{
+    if (_decode_ahead == 0)
+        return push(bag, message);
+
+    const auto& index    = _bags.index(bag);
+    const auto  chunk_id = index.chunkId(message);
+
+    auto chunk = std::find_if(_pending_chunks.begin(), _pending_chunks.end(), [&](const PendingChunk& pending) {
+        return pending.bag == bag && pending.chunk_id == chunk_id;
+    });
+
+    if (chunk == _pending_chunks.end()) {
+        // The oldest chunks leave the window once their messages are pushed
+        while (_pending_chunks.size() >= _decode_ahead)
+            if (!pushPending())
+                return false;
+
+        // A cached chunk is already decoded
+        std::shared_future<ChunkData> data;
+        if (const auto* cached = _cache.find(bag, chunk_id)) {
+            std::promise<ChunkData> decoded;
+            decoded.set_value(*cached);
+            data = decoded.get_future().share();
+        } else {
+            // The kernel reads a mapped chunk in the background while the window before it is played
+            _readers[bag]->advise(index.chunks().at(chunk_id));
+            data = _decoder.decode(*_readers[bag], index.chunks().at(chunk_id));
+        }
+
+        _pending_chunks.push_back(PendingChunk{bag, chunk_id, std::move(data), 0});
+        chunk = std::prev(_pending_chunks.end());
+    }
+
+    ++chunk->messages;
+    _pending_messages.push_back(PendingMessage{bag, message});
+
+    return true;
+}
+
+bool MessagePrefetcher::pushPending(void)
+{
+    const auto pending  = _pending_messages.front();
+    const auto chunk_id = _bags.index(pending.bag).chunkId(pending.message);
+    _pending_messages.pop_front();
+
+    auto chunk = std::find_if(_pending_chunks.begin(), _pending_chunks.end(), [&](const PendingChunk& candidate) {
+        return candidate.bag == pending.bag && candidate.chunk_id == chunk_id;
+    });
+
+    // Chunks overlapping in time may alternate, the decoded chunk is handed over again
+    auto& reader = *_readers[pending.bag];
+    if (!reader.hasChunk(chunk_id)) {
+        const auto& decoded = chunk->data.get();
+        reader.setChunk(chunk_id, decoded);
+        _cache.insert(pending.bag, chunk_id, decoded);
+    }
+
+    if (--chunk->messages == 0)
+        _pending_chunks.erase(chunk);
+
+    return push(pending.bag, pending.message);
+}
+
+bool MessagePrefetcher::flush(void)
+{
+    while (!_pending_messages.empty())
+        if (!pushPending())
+            return false;
+
+    return true;
+}
+
+} // namespace rosbag_rviz_panel
@@ -1,16 +1,176 @@
 #include "rosbag_rviz_panel/QCustomProgressBar.h"
 
 #include <QApplication>
+#include <QMenu>
+#include <QPainter>
+#include <algorithm>
+#include <cmath>
 
 namespace rosbag_rviz_panel {
 
-QCustomProgressBar::QCustomProgressBar(QWidget* parent) : QProgressBar(parent) {}
+QCustomProgressBar::QCustomProgressBar(QWidget* parent) : QProgressBar(parent)
+{
+    setRange(0, RESOLUTION);
+}
 
 QCustomProgressBar::~QCustomProgressBar() {}
 
+void QCustomProgressBar::setMarkers(const double start, const double end)
+{
+    if (start == _marker_start && end == _marker_end)
+        return;
+
+    _marker_start = start;
+    _marker_end   = end;
+    update();
+}
+
+void QCustomProgressBar::setProgress(const double progress)
+{
+    setValue(static_cast<int>(std::lround(std::min(std::max(progress, 0.0), 1.0) * RESOLUTION)));
+}
+
+void QCustomProgressBar::setDensity(const std::vector<uint32_t>& messages, const std::vector<uint64_t>& bytes)
+{
+    _density_messages.assign(messages.begin(), messages.end());
+    _density_bytes.assign(bytes.begin(), bytes.end());
+    _strip = QImage();
+    update();
+}
+
+void QCustomProgressBar::setDensityTopics(const QStringList& topics)
+{
+    _density_topics = topics;
+    _density_topic.clear();
+}
+
+void QCustomProgressBar::updateStrip(void)
+{
+    const auto& density = _show_bytes ? _density_bytes : _density_messages;
+    const int   columns = width();
+    if (density.empty() || columns <= 0)
+        return;
+
+    // Each column sums its bins, or repeats the bin it falls in when the columns outnumber the bins
+    std::vector<double> sums(columns, 0.0);
+    for (int column = 0; column < columns; ++column) {
+        const std::size_t first = static_cast<std::size_t>(column) * density.size() / columns;
+        const std::size_t last  = std::max(first + 1, static_cast<std::size_t>(column + 1) * density.size() / columns);
+        for (std::size_t bin = first; bin < last; ++bin)
+            sums[column] += density[bin];
+    }
+
+    const double peak = std::log1p(*std::max_element(sums.begin(), sums.end()));
+
+    _strip = QImage(columns, 1, QImage::Format_ARGB32);
+    for (int column = 0; column < columns; ++column) {
+        const double heat = peak > 0.0 ? std::log1p(sums[column]) / peak : 0.0;
+        // From yellow for the sparse columns to red for the busiest, the empty ones are left out
+        const QColor color = heat > 0.0 ? QColor::fromHsvF((1.0 - heat) / 6.0, 1.0, 1.0, 0.4 + 0.6 * heat)
+                                        : QColor(Qt::transparent);
+        _strip.setPixel(column, 0, color.rgba());
+    }
+}
+
+void QCustomProgressBar::resizeEvent(QResizeEvent* event)
+{
+    QProgressBar::resizeEvent(event);
+
+    // Only downsampled again when the bar is drawn
+    _strip = QImage();
+}
+
+void QCustomProgressBar::contextMenuEvent(QContextMenuEvent* event)
+{
+    if (_density_messages.empty())
+        return;
+
+    QMenu    menu(this);
+    QAction* messages = menu.addAction("Message density");
+    QAction* bytes    = menu.addAction("Byte density");
+    messages->setCheckable(true);
+    bytes->setCheckable(true);
+    messages->setChecked(!_show_bytes);
+    bytes->setChecked(_show_bytes);
+
+    // The density of a single topic is computed by the player, the strip is updated once it is received
+    menu.addSeparator();
+    QMenu*   topics     = menu.addMenu("Topic");
+    QAction* all_topics = topics->addAction("All selected topics");
+    all_topics->setCheckable(true);
+    all_topics->setChecked(_density_topic.isEmpty());
+    topics->addSeparator();
+    for (const auto& topic : _density_topics) {
+        QAction* action = topics->addAction(topic);
+        action->setData(topic);
+        action->setCheckable(true);
+        action->setChecked(topic == _density_topic);
+    }
+
+    const QAction* chosen = menu.exec(event->globalPos());
+    if (chosen == nullptr)
+        return;
+
+    if (chosen == messages || chosen == bytes) {
+        if ((chosen == bytes) == _show_bytes)
+            return;
+
+        _show_bytes = chosen == bytes;
+        _strip      = QImage();
+        update();
+        return;
+    }
+
+    const auto topic = chosen == all_topics ? QString() : chosen->data().toString();
+    if (topic == _density_topic)
+        return;
+
+    _density_topic = topic;
+    Q_EMIT sendDensityTopic(_density_topic);
+}
+
+void QCustomProgressBar::paintEvent(QPaintEvent* event)
+{
+    QProgressBar::paintEvent(event);
+
+    if (_strip.isNull())
+        updateStrip();
+
+    // The strip is drawn along the bottom of the bar, under the markers
+    if (!_strip.isNull()) {
+        const int strip_height = std::max(3, height() / 4);
+        QPainter  painter(this);
+        painter.drawImage(QRect(0, height() - strip_height, width(), strip_height), _strip);
+    }
+
+    if (_marker_start < 0.0 && _marker_end < 0.0)
+        return;
+
+    // The range is shaded between the markers, a missing marker is the edge of the bar
+    const int start = static_cast<int>((_marker_start < 0.0 ? 0.0 : _marker_start) * (width() - 1));
+    const int end   = static_cast<int>((_marker_end < 0.0 ? 1.0 : _marker_end) * (width() - 1));
+
+    QPainter painter(this);
+    QColor   color = palette().color(QPalette::Highlight).darker();
+    color.setAlpha(64);
+    painter.fillRect(start, 0, end - start + 1, height(), color);
+
+    color.setAlpha(255);
+    painter.setPen(color);
+    if (_marker_start >= 0.0)
+        painter.drawLine(start, 0, start, height());
+    if (_marker_end >= 0.0)
+        painter.drawLine(end, 0, end, height());
+}
+
 void QCustomProgressBar::mousePressEvent(QMouseEvent* event)
 {
     event->ignore();
+
+    // The right button opens the density menu
+    if (event->button() != Qt::LeftButton)
+        return;
+
     if ((windowType() == Qt::Popup)) {
         event->accept();
         QWidget* w;
@@ -24,9 +184,10 @@ void QCustomProgressBar::mousePressEvent(QMouseEvent* event)
         }
     }
 
-    int newValue = minimum() + ((maximum() - minimum()) * event->x()) / width();
-    setValue(newValue);
+    // The pixel clicked, not a rounded percentage, so a click on a long bag lands where it was aimed
+    const double progress = width() > 1 ? std::min(std::max(event->x() / (width() - 1.0), 0.0), 1.0) : 0.0;
+    setProgress(progress);
 
-    Q_EMIT sendClickedProgress(newValue);
+    Q_EMIT sendClickedProgress(progress);
 }
 } // namespace rosbag_rviz_panel
\ No newline at end of file
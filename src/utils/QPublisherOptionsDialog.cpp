@@ -0,0 +1,86 @@
+#include "rosbag_rviz_panel/QPublisherOptionsDialog.h"
+
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QHeaderView>
+#include <QVBoxLayout>
+
+#include <limits>
+
+// Shown instead of the minimum of the topic queue size boxes, which uses the default queue size
+#define DEFAULT_QUEUE_SIZE -1
+
+namespace rosbag_rviz_panel {
+
+QPublisherOptionsDialog::QPublisherOptionsDialog(
+        const QStringList&      topics,
+        const PublisherOptions& options,
+        QWidget*                parent) :
+        QDialog(parent),
+        _options(options),
+        _topics(topics)
+{
+    setWindowTitle("Publishers");
+
+    _prefix_edit = new QLineEdit(QString::fromStdString(options.prefix), this);
+    _prefix_edit->setPlaceholderText("/replay");
+    _prefix_edit->setToolTip("Prefix of the published topics, empty to publish on the topics of the bags");
+
+    _queue_size_spinbox = new QSpinBox(this);
+    _queue_size_spinbox->setRange(0, std::numeric_limits<int>::max());
+    _queue_size_spinbox->setSpecialValueText("Unbounded");
+    _queue_size_spinbox->setValue(static_cast<int>(options.queue_size));
+    _queue_size_spinbox->setToolTip("Queue size of the topics without their own queue size");
+
+    _topics_table = new QTableWidget(topics.size(), 2, this);
+    _topics_table->setHorizontalHeaderLabels({"Topic", "Queue size"});
+    _topics_table->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+    _topics_table->verticalHeader()->setVisible(false);
+    for (int row = 0; row < topics.size(); ++row) {
+        auto* topic = new QTableWidgetItem(topics[row]);
+        topic->setFlags(topic->flags() & ~Qt::ItemIsEditable);
+        _topics_table->setItem(row, 0, topic);
+
+        auto* queue_size = new QSpinBox(_topics_table);
+        queue_size->setRange(DEFAULT_QUEUE_SIZE, std::numeric_limits<int>::max());
+        queue_size->setSpecialValueText("Default");
+        const auto current = options.queue_sizes.find(topics[row].toStdString());
+        queue_size->setValue(
+                current != options.queue_sizes.end() ? static_cast<int>(current->second) : DEFAULT_QUEUE_SIZE);
+        _topics_table->setCellWidget(row, 1, queue_size);
+    }
+
+    auto* form = new QFormLayout;
+    form->addRow("Topic prefix", _prefix_edit);
+    form->addRow("Default queue size", _queue_size_spinbox);
+
+    auto* buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    auto* layout = new QVBoxLayout(this);
+    layout->addLayout(form);
+    layout->addWidget(_topics_table);
+    layout->addWidget(buttons);
+}
+
+QPublisherOptionsDialog::~QPublisherOptionsDialog() {}
+
+PublisherOptions QPublisherOptionsDialog::options(void) const
+{
+    PublisherOptions options = _options;
+    options.prefix           = _prefix_edit->text().trimmed().toStdString();
+    options.queue_size       = static_cast<uint32_t>(_queue_size_spinbox->value());
+
+    for (int row = 0; row < _topics.size(); ++row) {
+        const auto  topic      = _topics[row].toStdString();
+        const auto* queue_size = static_cast<const QSpinBox*>(_topics_table->cellWidget(row, 1));
+        if (queue_size->value() == DEFAULT_QUEUE_SIZE)
+            options.queue_sizes.erase(topic);
+        else
+            options.queue_sizes[topic] = static_cast<uint32_t>(queue_size->value());
+    }
+
+    return options;
+}
+} // namespace rosbag_rviz_panel